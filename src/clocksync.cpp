@@ -0,0 +1,155 @@
+#include "clocksync.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Residuals further than this many robust standard deviations from the median are outliers
+static const double k_flOutlierSigmas = 3.0;
+// Floor for the robust standard deviation so a very clean window doesn't reject everything
+static const double k_flMinSigmaSeconds = 0.0005;
+// Sensor time covered by one bucket, 256 buckets make a 64 second window for the drift fit
+static const double k_flBucketSeconds = 0.25;
+// A sample this far off the current fit means the sensor clock restarted
+static const double k_flResyncThresholdSeconds = 1.0;
+
+CClockSync::CClockSync()
+{
+    Reset();
+}
+
+void CClockSync::Reset()
+{
+    m_unBucketCount = 0;
+    m_unCurrentBucket = 0;
+    m_flBucketStart = 0.0;
+    m_flLastSensorTime = 0.0;
+    m_flSensorOrigin = 0.0;
+    m_flHostOrigin = 0.0;
+    m_flOffset = 0.0;
+    m_flDrift = 0.0;
+}
+
+void CClockSync::AddSample( double flSensorTime, double flHostTime )
+{
+    if ( m_unBucketCount > 0 )
+    {
+        // the sensor was reopened or its clock jumped, previous samples no longer apply
+        if ( flSensorTime <= m_flLastSensorTime
+            || ( IsValid() && fabs( flHostTime - SensorToHost( flSensorTime ) ) > k_flResyncThresholdSeconds ) )
+        {
+            Reset();
+        }
+    }
+
+    if ( m_unBucketCount == 0 )
+    {
+        m_flSensorOrigin = flSensorTime;
+        m_flHostOrigin = flHostTime;
+    }
+
+    m_flLastSensorTime = flSensorTime;
+
+    const double flSensor = flSensorTime - m_flSensorOrigin;
+    const double flOffset = ( flHostTime - m_flHostOrigin ) - flSensor;
+
+    if ( m_unBucketCount == 0 || flSensor - m_flBucketStart >= k_flBucketSeconds )
+    {
+        // start a new bucket, overwriting the oldest one once the window is full
+        if ( m_unBucketCount > 0 )
+            m_unCurrentBucket = ( m_unCurrentBucket + 1 ) % k_unWindowSize;
+        if ( m_unBucketCount < k_unWindowSize )
+            ++m_unBucketCount;
+
+        m_flBucketStart = flSensor;
+        m_flSensorTimes[ m_unCurrentBucket ] = flSensor;
+        m_flOffsets[ m_unCurrentBucket ] = flOffset;
+    }
+    else if ( flOffset < m_flOffsets[ m_unCurrentBucket ] )
+    {
+        m_flSensorTimes[ m_unCurrentBucket ] = flSensor;
+        m_flOffsets[ m_unCurrentBucket ] = flOffset;
+    }
+    else
+    {
+        // a later delivery than what the bucket already holds doesn't change the fit
+        return;
+    }
+
+    Fit();
+}
+
+double CClockSync::SensorToHost( double flSensorTime ) const
+{
+    const double flSensor = flSensorTime - m_flSensorOrigin;
+    return m_flHostOrigin + flSensor + m_flOffset + m_flDrift * flSensor;
+}
+
+// Least squares line through the selected samples, offset = intercept + slope * sensor
+static void FitLine( const double *pflX, const double *pflY, const bool *pbUse, uint32_t unCount, double *pflIntercept, double *pflSlope )
+{
+    double flSumX = 0.0, flSumY = 0.0;
+    uint32_t unUsed = 0;
+    for ( uint32_t i = 0; i < unCount; ++i )
+    {
+        if ( !pbUse[ i ] )
+            continue;
+        flSumX += pflX[ i ];
+        flSumY += pflY[ i ];
+        ++unUsed;
+    }
+
+    if ( unUsed == 0 )
+        return;
+
+    const double flMeanX = flSumX / unUsed;
+    const double flMeanY = flSumY / unUsed;
+
+    double flSxx = 0.0, flSxy = 0.0;
+    for ( uint32_t i = 0; i < unCount; ++i )
+    {
+        if ( !pbUse[ i ] )
+            continue;
+        const double dx = pflX[ i ] - flMeanX;
+        flSxx += dx * dx;
+        flSxy += dx * ( pflY[ i ] - flMeanY );
+    }
+
+    // all samples at the same sensor time, only the offset is observable
+    *pflSlope = flSxx > 0.0 ? flSxy / flSxx : 0.0;
+    *pflIntercept = flMeanY - *pflSlope * flMeanX;
+}
+
+void CClockSync::Fit()
+{
+    const uint32_t unCount = m_unBucketCount;
+
+    bool bUse[ k_unWindowSize ];
+    double flResiduals[ k_unWindowSize ];
+    double flSorted[ k_unWindowSize ];
+
+    std::fill( bUse, bUse + unCount, true );
+
+    double flOffset = m_flOffset, flDrift = m_flDrift;
+    FitLine( m_flSensorTimes, m_flOffsets, bUse, unCount, &flOffset, &flDrift );
+
+    // reject buckets that only saw late deliveries using the median absolute deviation of the first fit
+    for ( uint32_t i = 0; i < unCount; ++i )
+        flResiduals[ i ] = m_flOffsets[ i ] - ( flOffset + flDrift * m_flSensorTimes[ i ] );
+
+    std::copy( flResiduals, flResiduals + unCount, flSorted );
+    std::nth_element( flSorted, flSorted + unCount / 2, flSorted + unCount );
+    const double flMedian = flSorted[ unCount / 2 ];
+
+    for ( uint32_t i = 0; i < unCount; ++i )
+        flSorted[ i ] = fabs( flResiduals[ i ] - flMedian );
+    std::nth_element( flSorted, flSorted + unCount / 2, flSorted + unCount );
+    const double flSigma = std::max( 1.4826 * flSorted[ unCount / 2 ], k_flMinSigmaSeconds );
+
+    for ( uint32_t i = 0; i < unCount; ++i )
+        bUse[ i ] = fabs( flResiduals[ i ] - flMedian ) <= k_flOutlierSigmas * flSigma;
+
+    FitLine( m_flSensorTimes, m_flOffsets, bUse, unCount, &flOffset, &flDrift );
+
+    m_flOffset = flOffset;
+    m_flDrift = flDrift;
+}
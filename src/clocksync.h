@@ -0,0 +1,59 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#pragma once
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps sensor timestamps onto the host monotonic clock.
+//
+// Every frame contributes a ( sensor time, host arrival time ) pair. Delivery
+// delays only ever add to the arrival time, so each short bucket of frames
+// keeps just its least delayed one. Offset and drift between the two clocks
+// are fitted by least squares over a sliding window of buckets, after
+// rejecting buckets whose residual is far from the median (a whole bucket of
+// late frames). All times are in seconds.
+//-----------------------------------------------------------------------------
+class CClockSync
+{
+public:
+    CClockSync();
+
+    void Reset();
+
+    void AddSample( double flSensorTime, double flHostTime );
+
+    // True once enough samples were collected for SensorToHost to be meaningful
+    bool IsValid() const { return m_unBucketCount >= k_unMinBuckets; }
+
+    // Host time at which a frame captured at flSensorTime would have arrived with no delivery jitter
+    double SensorToHost( double flSensorTime ) const;
+
+    // Estimated sensor clock drift against the host clock, in parts per million
+    double GetDriftPpm() const { return m_flDrift * 1.0e6; }
+
+private:
+    void Fit();
+
+    static const uint32_t k_unWindowSize = 256;
+    static const uint32_t k_unMinBuckets = 4;
+
+    // Least delayed sample of each bucket, the newest bucket is still being filled
+    double m_flSensorTimes[ k_unWindowSize ];
+    double m_flOffsets[ k_unWindowSize ];      // host time - sensor time
+    uint32_t m_unBucketCount;
+    uint32_t m_unCurrentBucket;
+    double m_flBucketStart;
+    double m_flLastSensorTime;
+
+    // Samples are stored relative to the first one to keep precision
+    double m_flSensorOrigin;
+    double m_flHostOrigin;
+
+    // host - sensor = m_flOffset + m_flDrift * sensor, relative to the origins
+    double m_flOffset;
+    double m_flDrift;
+};
+
+#endif // CLOCKSYNC_H
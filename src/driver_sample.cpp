@@ -1,10 +1,22 @@
 #include <openvr_driver.h>
 #include "driverlog.h"
+#include "clocksync.h"
+#include "drivertrace.h"
+#include "handskeleton.h"
+#include "jointrotations.h"
+#include "posepipeline.h"
+#include "skeletonrecording.h"
 
 #include <vector>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
 #include <cstring>
+#include <cstdio>
+#include <cmath>
 
 #if defined( _WINDOWS )
 #include <windows.h>
@@ -12,90 +24,293 @@
 
 using namespace vr;
 
+#include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <Kinect.h>
+// posepipeline.h mirrors these so it and tools/trackeval build without the SDK
+static_assert(k_unBodyJointCount == JointType_Count && k_unMaxBodies == BODY_COUNT, "pose pipeline body limits out of date");
+static_assert(k_unBodyJointWristLeft == JointType_WristLeft && k_unBodyJointHandLeft == JointType_HandLeft
+    && k_unBodyJointHandTipLeft == JointType_HandTipLeft && k_unBodyJointWristRight == JointType_WristRight
+    && k_unBodyJointHandRight == JointType_HandRight && k_unBodyJointHandTipRight == JointType_HandTipRight,
+    "pose pipeline joint indices out of date");
+
 IKinectSensor* sensor;      // Kinect sensor
 IBodyFrameReader* reader;       // Body frame reader
 ICoordinateMapper* mapper;      // Converts between depth, color, and 3d coordinates
 
+// Sensor bring-up runs on its own thread so a slow or missing Kinect never stalls Activate().
+// kinectMutex guards sensor/reader/mapper while that thread (re)opens or releases them.
+std::mutex kinectMutex;
+std::thread *kinectThread = nullptr;
+std::mutex kinectThreadMutex;
+std::condition_variable kinectThreadWake;
+bool kinectThreadExiting = false;
+std::atomic<bool> receivedFirstFrame{false};    // no pose is valid until the sensor delivered a body frame
+// Standby pauses body tracking. The request is applied by whichever thread next holds kinectMutex,
+// so the RunFrame thread never waits on the sensor thread for it.
+std::atomic<bool> bodyReaderPauseRequested{false};
+bool bodyReaderPaused = false;      // pause state of the current reader, guarded by kinectMutex
+
+// Brings the reader in line with bodyReaderPauseRequested, call with kinectMutex held
+void applyBodyReaderPause() {
+    const bool paused = bodyReaderPauseRequested;
+    if (reader && paused != bodyReaderPaused && SUCCEEDED(reader->put_IsPaused(paused ? TRUE : FALSE))) {
+        bodyReaderPaused = paused;
+    }
+}
+
 // Body tracking variables
 bool trackedFirstFrame = true;
 BOOLEAN tracked;                    // Do we see a body
+std::chrono::steady_clock::time_point lastBodyTrackedTime;     // when processBody last saw a tracked body
 Joint joints[JointType_Count];      // List of joints in the tracked body
+BodyJoint_t bodyJoints[JointType_Count];    // joints above in the form the pose pipeline takes
+uint64_t bodyFrameIndex = 0;        // bumped whenever the joints above change
+JointOrientation jointOrientations[JointType_Count];    // Sensor orientations of the joints above
+CJointRotations jointRotations;     // jointOrientations converted into device rotations
+
+// Joint names used by the per-joint settings, in JointType order
+static const char * const k_pchJointNames[JointType_Count] = {
+    "SpineBase", "SpineMid", "Neck", "Head",
+    "ShoulderLeft", "ElbowLeft", "WristLeft", "HandLeft",
+    "ShoulderRight", "ElbowRight", "WristRight", "HandRight",
+    "HipLeft", "KneeLeft", "AnkleLeft", "FootLeft",
+    "HipRight", "KneeRight", "AnkleRight", "FootRight",
+    "SpineShoulder", "HandTipLeft", "ThumbLeft", "HandTipRight", "ThumbRight",
+};
 
 // Hand tracking variables
 HandState leftHandState = HandState_Unknown;
 HandState rightHandState = HandState_Unknown;
 
+// Body frame timing. The sensor's relative time is mapped onto the steady clock, which is
+// QueryPerformanceCounter based like the timing SteamVR uses for poses.
+CClockSync bodyClockSync;
+double bodyFrameTime = 0.0;         // sensor relative time of the last body frame, in seconds
+double bodyFrameArrivalTime = 0.0;  // host time the last body frame was acquired at, in seconds
+float sensorLatencySeconds = 0.f;   // capture to delivery latency the clock sync can't observe
+
+double hostTimeSeconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double>(time.time_since_epoch()).count();
+}
+
+// How old the joints from the last body frame are right now, in seconds. 0 until the clock sync converged.
+double getBodyFrameAge() {
+    if (!bodyClockSync.IsValid()) {
+        return 0.0;
+    }
+    return hostTimeSeconds(std::chrono::steady_clock::now()) - bodyClockSync.SensorToHost(bodyFrameTime) + sensorLatencySeconds;
+}
+
+// Raw body frame recording for tools/trackeval, toggled by debug requests
+std::mutex recordingMutex;
+FILE *recordingFile = nullptr;
+std::atomic<bool> recording{false};
+
+void toBodyJoints(const Joint *pJoints, BodyJoint_t *pBodyJoints) {
+    for (int i = 0; i < JointType_Count; ++i) {
+        pBodyJoints[i].position = glm::vec3(pJoints[i].Position.X, pJoints[i].Position.Y, pJoints[i].Position.Z);
+        pBodyJoints[i].nTrackingState = pJoints[i].TrackingState;
+    }
+}
+
+bool startRecording(const char *pchPath) {
+    std::lock_guard<std::mutex> lock(recordingMutex);
+    if (recordingFile) {
+        fclose(recordingFile);
+        recordingFile = nullptr;
+    }
+
+    if (fopen_s(&recordingFile, pchPath, "w") != 0 || !recordingFile) {
+        recordingFile = nullptr;
+        recording = false;
+        return false;
+    }
+
+    WriteRecordingHeader(recordingFile);
+    recording = true;
+    DriverLog("Recording body frames to %s\n", pchPath);
+    return true;
+}
+
+void stopRecording() {
+    std::lock_guard<std::mutex> lock(recordingMutex);
+    recording = false;
+    if (recordingFile) {
+        fclose(recordingFile);
+        recordingFile = nullptr;
+        DriverLog("Stopped recording body frames\n");
+    }
+}
+
+void recordBodyFrame(int nBodyCount, IBody** ppBodies, const bool *pbTracked) {
+    TRACE_SCOPE("recordBodyFrame");
+
+    static RecordedBodyFrame_t frame;
+    frame.flSensorTime = bodyFrameTime;
+    frame.flHostTime = bodyFrameArrivalTime;
+
+    for (int i = 0; i < BODY_COUNT; ++i) {
+        RecordedBody_t &body = frame.bodies[i];
+        body.bTracked = false;
+        if (i >= nBodyCount || !pbTracked[i]) {
+            continue;
+        }
+
+        Joint bodyJointsRaw[JointType_Count];
+        JointOrientation bodyOrientations[JointType_Count];
+        HandState handLeft = HandState_Unknown, handRight = HandState_Unknown;
+        if (FAILED(ppBodies[i]->GetJoints(_countof(bodyJointsRaw), bodyJointsRaw))) {
+            continue;
+        }
+        if (FAILED(ppBodies[i]->GetJointOrientations(_countof(bodyOrientations), bodyOrientations))) {
+            memset(bodyOrientations, 0, sizeof(bodyOrientations));
+        }
+        ppBodies[i]->get_HandLeftState(&handLeft);
+        ppBodies[i]->get_HandRightState(&handRight);
+
+        body.bTracked = true;
+        body.nHandLeftState = handLeft;
+        body.nHandRightState = handRight;
+        toBodyJoints(bodyJointsRaw, body.joints);
+        for (int j = 0; j < JointType_Count; ++j) {
+            body.flOrientations[j][0] = bodyOrientations[j].Orientation.x;
+            body.flOrientations[j][1] = bodyOrientations[j].Orientation.y;
+            body.flOrientations[j][2] = bodyOrientations[j].Orientation.z;
+            body.flOrientations[j][3] = bodyOrientations[j].Orientation.w;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(recordingMutex);
+    if (recordingFile) {
+        WriteRecordedFrame(recordingFile, frame);
+    }
+}
+
 HRESULT initKinect() {
-    HRESULT hr;
+    TRACE_SCOPE("initKinect");
 
-    hr = GetDefaultKinectSensor(&sensor);
-    if (FAILED(hr)) {
-        return hr;
+    IKinectSensor *pSensor = NULL;
+    ICoordinateMapper *pMapper = NULL;
+    IBodyFrameReader *pReader = NULL;
+
+    HRESULT hr = GetDefaultKinectSensor(&pSensor);
+
+    if (SUCCEEDED(hr) && !pSensor) {
+        hr = E_FAIL;
     }
 
-    if (sensor) {
+    if (SUCCEEDED(hr)) {
         // Initialize the Kinect and get coordinate mapper and the body reader
         IBodyFrameSource *pBodyFrameSource = NULL;
 
-        hr = sensor->Open();
+        hr = pSensor->Open();
 
         if (SUCCEEDED(hr)) {
-            hr = sensor->get_CoordinateMapper(&mapper);
+            hr = pSensor->get_CoordinateMapper(&pMapper);
         }
 
         if (SUCCEEDED(hr)) {
-            hr = sensor->get_BodyFrameSource(&pBodyFrameSource);
+            hr = pSensor->get_BodyFrameSource(&pBodyFrameSource);
         }
 
         if (SUCCEEDED(hr)) {
-            hr = pBodyFrameSource->OpenReader(&reader);
+            hr = pBodyFrameSource->OpenReader(&pReader);
+        }
+
+        if (pBodyFrameSource) {
+            pBodyFrameSource->Release();
+            pBodyFrameSource = NULL;
         }
+    }
 
-        pBodyFrameSource->Release();
-        pBodyFrameSource = NULL;
+    if (FAILED(hr)) {
+        if (pReader) pReader->Release();
+        if (pMapper) pMapper->Release();
+        if (pSensor) {
+            pSensor->Close();
+            pSensor->Release();
+        }
+        return hr;
     }
 
+    std::lock_guard<std::mutex> lock(kinectMutex);
+    sensor = pSensor;
+    mapper = pMapper;
+    reader = pReader;
+    // a reader reopened while in standby starts paused
+    bodyReaderPaused = false;
+    applyBodyReaderPause();
     return hr;
 }
 
 void processBody(int nBodyCount, IBody** ppBodies) {
-    HRESULT hr = S_OK;
+    TRACE_SCOPE("processBody");
 
-    if (SUCCEEDED(hr) && mapper) {
-        for (int i = 0; i < nBodyCount; ++i) {
-            IBody *pBody = ppBodies[i];
-            if (pBody) {
-                hr = pBody->get_IsTracked(&tracked);
+    bool bodyTracked[BODY_COUNT] = {};
+    for (int i = 0; i < nBodyCount && i < BODY_COUNT; ++i) {
+        BOOLEAN isTracked = FALSE;
+        bodyTracked[i] = ppBodies[i] && SUCCEEDED(ppBodies[i]->get_IsTracked(&isTracked)) && isTracked;
+    }
 
-                if (SUCCEEDED(hr) && tracked) {
-                    //Joint joints[JointType_Count];
+    if (recording) {
+        recordBodyFrame(nBodyCount, ppBodies, bodyTracked);
+    }
 
-                    pBody->get_HandLeftState(&leftHandState);
-                    pBody->get_HandRightState(&rightHandState);
+    // body selection is shared with tools/trackeval through the pose pipeline
+    const int selectedBody = mapper ? SelectTrackedBody(bodyTracked, nBodyCount < BODY_COUNT ? nBodyCount : BODY_COUNT) : -1;
+    tracked = selectedBody >= 0;
 
-                    hr = pBody->GetJoints(_countof(joints), joints);
-                    if (SUCCEEDED(hr)) {
-                        return;
-                    }
-                }
+    if (selectedBody >= 0) {
+        IBody *pBody = ppBodies[selectedBody];
+
+        pBody->get_HandLeftState(&leftHandState);
+        pBody->get_HandRightState(&rightHandState);
+
+        if (SUCCEEDED(pBody->GetJoints(_countof(joints), joints))) {
+            lastBodyTrackedTime = std::chrono::steady_clock::now();
+
+            // without orientations every joint falls back to the two-point rotation
+            if (FAILED(pBody->GetJointOrientations(_countof(jointOrientations), jointOrientations))) {
+                memset(jointOrientations, 0, sizeof(jointOrientations));
             }
+
+            TRACE_SCOPE("ConvertJointOrientations");
+            jointRotations.Convert(&jointOrientations[0].Orientation.x, sizeof(JointOrientation) / sizeof(float), JointType_Count);
+            toBodyJoints(joints, bodyJoints);
+            ++bodyFrameIndex;
+            return;
         }
     }
     trackedFirstFrame = true;
 }
 
 void getBodyData() {
-    if (!reader) {
+    // Never wait on the sensor thread, a frame skipped while it reconnects is picked up next time
+    std::unique_lock<std::mutex> lock(kinectMutex, std::try_to_lock);
+    if (!lock.owns_lock() || !reader) {
         return;
     }
+    applyBodyReaderPause();
 
     IBodyFrame *pBodyFrame = NULL;
 
-    HRESULT hr = reader->AcquireLatestFrame(&pBodyFrame);
+    HRESULT hr;
+    {
+        TRACE_SCOPE("AcquireLatestFrame");
+        hr = reader->AcquireLatestFrame(&pBodyFrame);
+    }
 
     if (SUCCEEDED(hr)) {
+        bodyFrameArrivalTime = hostTimeSeconds(std::chrono::steady_clock::now());
+
+        TIMESPAN relativeTime = 0;
+        if (SUCCEEDED(pBodyFrame->get_RelativeTime(&relativeTime))) {
+            // TIMESPAN is in 100ns ticks
+            bodyFrameTime = relativeTime * 1.0e-7;
+            bodyClockSync.AddSample(bodyFrameTime, bodyFrameArrivalTime);
+        }
+
         IBody *ppBodies[BODY_COUNT] = {0};
 
         if (SUCCEEDED(hr)) {
@@ -104,11 +319,14 @@ void getBodyData() {
 
         if (SUCCEEDED(hr)) {
             processBody(BODY_COUNT, ppBodies);
+            receivedFirstFrame = true;
         }
 
         for (int i = 0; i < _countof(ppBodies); ++i) {
-            ppBodies[i]->Release();
-            ppBodies[i] = NULL;
+            if (ppBodies[i]) {
+                ppBodies[i]->Release();
+                ppBodies[i] = NULL;
+            }
         }
 
         pBodyFrame->Release();
@@ -116,13 +334,156 @@ void getBodyData() {
     }
 }
 
+// Stops or restarts body frame delivery, the sensor stops tracking bodies while no reader is active.
+// Applied right away unless the sensor thread holds the reader, then by the sensor thread's next poll.
+void setBodyReaderPaused(bool paused) {
+    bodyReaderPauseRequested = paused;
+
+    std::unique_lock<std::mutex> lock(kinectMutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        applyBodyReaderPause();
+    }
+}
+
+// Reads the optional "jointOffset_<JointName>" settings, each a "w x y z" quaternion
+void loadJointOffsets(const char *pchSection) {
+    for (int i = 0; i < JointType_Count; ++i) {
+        char key[64];
+        snprintf(key, sizeof(key), "jointOffset_%s", k_pchJointNames[i]);
+
+        char buf[128] = "";
+        vr::EVRSettingsError error = vr::VRSettingsError_None;
+        vr::VRSettings()->GetString(pchSection, key, buf, sizeof(buf), &error);
+        if (error != vr::VRSettingsError_None || !buf[0]) {
+            continue;
+        }
+
+        float w, x, y, z;
+        if (sscanf_s(buf, "%f %f %f %f", &w, &x, &y, &z) != 4) {
+            DriverLog("Ignoring %s, expected \"w x y z\" but got \"%s\"\n", key, buf);
+            continue;
+        }
+
+        jointRotations.SetOffset(i, w, x, y, z);
+    }
+}
+
 void terminateKinect(){
-    mapper->Release();
-    mapper = NULL;
-    reader->Release();
-    reader = NULL;
-    sensor->Close();
-    sensor = NULL;
+    std::lock_guard<std::mutex> lock(kinectMutex);
+
+    if (mapper) {
+        mapper->Release();
+        mapper = NULL;
+    }
+    if (reader) {
+        reader->Release();
+        reader = NULL;
+    }
+    if (sensor) {
+        sensor->Close();
+        sensor->Release();
+        sensor = NULL;
+    }
+
+    receivedFirstFrame = false;
+}
+
+// Sleeps on the sensor thread, returns false if the thread is asked to exit meanwhile
+bool waitKinectThread(std::chrono::milliseconds duration) {
+    std::unique_lock<std::mutex> lock(kinectThreadMutex);
+    return !kinectThreadWake.wait_for(lock, duration, [] { return kinectThreadExiting; });
+}
+
+void kinectThreadFunction() {
+    TRACE_THREAD_NAME("Kinect");
+
+    // Reconnect backoff, doubled after every failed attempt
+    const std::chrono::milliseconds k_minBackoff(250);
+    const std::chrono::milliseconds k_maxBackoff(8000);
+    // How often the sensor availability is polled once open
+    const std::chrono::milliseconds k_availablePollInterval(500);
+    // The Kinect runtime recovers from short dropouts on its own, only reopen after this long
+    const std::chrono::milliseconds k_unavailableGracePeriod(3000);
+
+    std::chrono::milliseconds backoff = k_minBackoff;
+    bool open = false;
+    // Open() succeeds without a sensor plugged in and the runtime can take seconds to bring one
+    // up, so only a sensor that was available since it was opened and then dropped out is reopened
+    bool wasAvailable = false;
+    std::chrono::steady_clock::time_point lastAvailable;
+
+    while (waitKinectThread(open ? k_availablePollInterval : std::chrono::milliseconds(0))) {
+        if (!open) {
+            HRESULT hr = initKinect();
+            if (FAILED(hr)) {
+                DriverLog("Kinect: failed to open sensor (0x%08x), retrying in %d ms\n", hr, (int)backoff.count());
+                if (!waitKinectThread(backoff))
+                    break;
+                backoff = std::min(backoff * 2, k_maxBackoff);
+                continue;
+            }
+
+            DriverLog("Kinect: sensor opened, waiting for it to become available\n");
+            open = true;
+            wasAvailable = false;
+            continue;
+        }
+
+        BOOLEAN available = FALSE;
+        {
+            std::lock_guard<std::mutex> lock(kinectMutex);
+            applyBodyReaderPause();
+            if (FAILED(sensor->get_IsAvailable(&available))) {
+                available = FALSE;
+            }
+        }
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (available) {
+            if (!wasAvailable) {
+                DriverLog("Kinect: sensor available\n");
+            }
+            wasAvailable = true;
+            lastAvailable = now;
+            backoff = k_minBackoff;
+            continue;
+        }
+
+        if (!wasAvailable || now - lastAvailable < k_unavailableGracePeriod)
+            continue;
+
+        DriverLog("Kinect: sensor unavailable, reconnecting in %d ms\n", (int)backoff.count());
+        terminateKinect();
+        open = false;
+        if (!waitKinectThread(backoff))
+            break;
+        backoff = std::min(backoff * 2, k_maxBackoff);
+    }
+
+    terminateKinect();
+}
+
+void startKinectThread() {
+    if (kinectThread)
+        return;
+
+    kinectThreadExiting = false;
+    kinectThread = new std::thread(kinectThreadFunction);
+}
+
+void stopKinectThread() {
+    if (!kinectThread)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(kinectThreadMutex);
+        kinectThreadExiting = true;
+    }
+    kinectThreadWake.notify_all();
+
+    kinectThread->join();
+    delete kinectThread;
+    kinectThread = nullptr;
 }
 
 #if defined(_WIN32)
@@ -174,6 +535,16 @@ static const char * const k_pch_Sample_RenderWidth_Int32 = "renderWidth";
 static const char * const k_pch_Sample_RenderHeight_Int32 = "renderHeight";
 static const char * const k_pch_Sample_SecondsFromVsyncToPhotons_Float = "secondsFromVsyncToPhotons";
 static const char * const k_pch_Sample_DisplayFrequency_Float = "displayFrequency";
+static const char * const k_pch_Sample_SkeletonBlendSeconds_Float = "skeletonBlendSeconds";
+static const char * const k_pch_Sample_LassoAsPoint_Bool = "lassoAsPoint";
+static const char * const k_pch_Sample_StandbyTimeoutSeconds_Float = "standbyTimeoutSeconds";
+static const char * const k_pch_Sample_PresenceCheckSeconds_Float = "presenceCheckSeconds";
+static const char * const k_pch_Sample_PresenceCheckWindowSeconds_Float = "presenceCheckWindowSeconds";
+static const char * const k_pch_Sample_SensorLatencySeconds_Float = "sensorLatencySeconds";
+static const char * const k_pch_Sample_FilterMinCutoff_Float = "filterMinCutoff";
+static const char * const k_pch_Sample_FilterBeta_Float = "filterBeta";
+static const char * const k_pch_Sample_FilterDerivativeCutoff_Float = "filterDerivativeCutoff";
+static const char * const k_pch_Sample_PredictionSeconds_Float = "predictionSeconds";
 
 //-----------------------------------------------------------------------------
 // Purpose:
@@ -201,6 +572,8 @@ bool g_bExiting = false;
 
 void WatchdogThreadFunction(  )
 {
+    TRACE_THREAD_NAME( "Watchdog" );
+
     while ( !g_bExiting )
     {
 #if defined( _WINDOWS )
@@ -316,7 +689,8 @@ public:
         // avoid "not fullscreen" warnings from vrmonitor
         vr::VRProperties()->SetBoolProperty( m_ulPropertyContainer, Prop_IsOnDesktop_Bool, false );
 
-        initKinect();
+        // opens the sensor in the background, poses stay uninitialized until the first body frame
+        startKinectThread();
 
         return VRInitError_None;
     }
@@ -324,7 +698,8 @@ public:
     virtual void Deactivate()
     {
         m_unObjectId = vr::k_unTrackedDeviceIndexInvalid;
-        terminateKinect();
+        stopKinectThread();
+        stopRecording();
     }
 
     virtual void EnterStandby()
@@ -347,6 +722,30 @@ public:
     {
         if( unResponseBufferSize >= 1 )
             pchResponseBuffer[0] = 0;
+
+        // "trace_dump <path>" writes the recorded timeline, see drivertrace.h
+        static const char k_pchTraceDump[] = "trace_dump ";
+        if ( !strncmp( pchRequest, k_pchTraceDump, sizeof( k_pchTraceDump ) - 1 ) )
+        {
+            const bool bDumped = TraceDump( pchRequest + sizeof( k_pchTraceDump ) - 1 );
+            if ( unResponseBufferSize >= 1 )
+                snprintf( pchResponseBuffer, unResponseBufferSize, bDumped ? "ok" : "failed" );
+        }
+
+        // "record_start <path>" / "record_stop" capture raw body frames for tools/trackeval
+        static const char k_pchRecordStart[] = "record_start ";
+        if ( !strncmp( pchRequest, k_pchRecordStart, sizeof( k_pchRecordStart ) - 1 ) )
+        {
+            const bool bStarted = startRecording( pchRequest + sizeof( k_pchRecordStart ) - 1 );
+            if ( unResponseBufferSize >= 1 )
+                snprintf( pchResponseBuffer, unResponseBufferSize, bStarted ? "ok" : "failed" );
+        }
+        else if ( !strcmp( pchRequest, "record_stop" ) )
+        {
+            stopRecording();
+            if ( unResponseBufferSize >= 1 )
+                snprintf( pchResponseBuffer, unResponseBufferSize, "ok" );
+        }
     }
 
     virtual void GetWindowBounds( int32_t *pnX, int32_t *pnY, uint32_t *pnWidth, uint32_t *pnHeight )
@@ -411,6 +810,8 @@ public:
 
     virtual DriverPose_t GetPose()
     {
+        TRACE_SCOPE_ARG( "GetPose", "HMD" );
+
         DriverPose_t pose = { 0 };
         pose.poseIsValid = true;
         pose.result = TrackingResult_Running_OK;
@@ -419,11 +820,19 @@ public:
         pose.qWorldFromDriverRotation = HmdQuaternion_Init( 1, 0, 0, 0 );
         pose.qDriverFromHeadRotation = HmdQuaternion_Init( 1, 0, 0, 0 );
 
+        if ( !receivedFirstFrame )
+        {
+            pose.poseIsValid = false;
+            pose.result = TrackingResult_Uninitialized;
+        }
+
         return pose;
     }
 
     void RunFrame()
     {
+        TRACE_SCOPE_ARG( "RunFrame", "HMD" );
+
         // In a real driver, this should happen from some pose tracking thread.
         // The RunFrame interval is unspecified and can be very irregular if some other
         // driver blocks it for some periodic task.
@@ -474,13 +883,33 @@ public:
             jTip = JointType_HandTipRight;
             jWrist = JointType_WristRight;
             jElbow = JointType_ElbowRight;
+            m_pHandState = &rightHandState;
+            m_pchTraceName = "CTRL_RIGHT";
         }
         else if(m_sSerialNumber == "CTRL_LEFT"){
             jHand = JointType_HandLeft;
             jTip = JointType_HandTipLeft;
             jWrist = JointType_WristLeft;
             jElbow = JointType_ElbowLeft;
+            m_pHandState = &leftHandState;
+            m_pchTraceName = "CTRL_LEFT";
         }
+
+        m_skeleton.Init( m_sSerialNumber == "CTRL_RIGHT" );
+
+        m_flSkeletonBlendSeconds = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_SkeletonBlendSeconds_Float );
+        m_bLassoAsPoint = vr::VRSettings()->GetBool( k_pch_Sample_Section, k_pch_Sample_LassoAsPoint_Bool );
+
+        m_flSkeletonTargetWeights[ HandSkeletonPose_Open ] = 1.f;
+
+        PosePipelineConfig_t pipelineConfig = DefaultPosePipelineConfig();
+        pipelineConfig.flMinCutoff = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_FilterMinCutoff_Float );
+        pipelineConfig.flBeta = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_FilterBeta_Float );
+        pipelineConfig.flDerivativeCutoff = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_FilterDerivativeCutoff_Float );
+        pipelineConfig.flPredictionSeconds = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_PredictionSeconds_Float );
+        if ( pipelineConfig.flDerivativeCutoff <= 0.f )
+            pipelineConfig.flDerivativeCutoff = DefaultPosePipelineConfig().flDerivativeCutoff;
+        m_pipeline.Init( pipelineConfig, jHand, jTip, jWrist );
     }
 
     virtual ~CSampleControllerDriver()
@@ -520,6 +949,15 @@ public:
         // create our haptic component
         vr::VRDriverInput()->CreateHapticComponent( m_ulPropertyContainer, "/output/haptic", &m_compHaptic );
 
+        // create the hand skeleton, driven by the tracked hand state
+        if ( m_sSerialNumber == "CTRL_RIGHT" )
+            vr::VRDriverInput()->CreateSkeletonComponent( m_ulPropertyContainer, "/input/skeleton/right", "/skeleton/hand/right", "/pose/raw", VRSkeletalTracking_Estimated, nullptr, 0, &m_compSkeleton );
+        else
+            vr::VRDriverInput()->CreateSkeletonComponent( m_ulPropertyContainer, "/input/skeleton/left", "/skeleton/hand/left", "/pose/raw", VRSkeletalTracking_Estimated, nullptr, 0, &m_compSkeleton );
+
+        m_skeleton.Invalidate();
+        m_lastSkeletonUpdate = std::chrono::steady_clock::now();
+
         /*
          * Maybe you don't
         //TODO: You know what to do
@@ -552,6 +990,8 @@ public:
     }
 
     virtual DriverPose_t GetPose(){
+        TRACE_SCOPE_ARG("GetPose", m_pchTraceName);
+
         DriverPose_t pose = { 0 };
         pose.poseIsValid = true;
         pose.result = TrackingResult_Running_OK;
@@ -560,16 +1000,21 @@ public:
         pose.qWorldFromDriverRotation = HmdQuaternion_Init( 1, 0, 0, 0 );
         pose.qDriverFromHeadRotation = HmdQuaternion_Init( 1, 0, 0, 0 );
 
-        const glm::vec3 hand = glm::vec3(joints[jTip].Position.X, joints[jTip].Position.Y, joints[jTip].Position.Z);
-        const glm::vec3 elbow = glm::vec3(joints[jElbow].Position.X, joints[jElbow].Position.Y, joints[jElbow].Position.Z);
-        const glm::vec3 wrist = glm::vec3(joints[jWrist].Position.X, joints[jWrist].Position.Y, joints[jWrist].Position.Z);
+        if (!receivedFirstFrame) {
+            pose.poseIsValid = false;
+            pose.result = TrackingResult_Uninitialized;
+            return pose;
+        }
+
+        // tell SteamVR when the pose is for, the body frame it was computed from moved on by any prediction
+        pose.poseTimeOffset = ( m_pipeline.GetPoseTime() - bodyFrameTime ) - getBodyFrameAge();
 
-        const glm::vec3 direction = glm::normalize(hand - wrist);
-        const glm::quat rotation = glm::quatLookAt(direction, glm::vec3(0, 1, 0));
+        const glm::vec3 &position = m_pipeline.GetPosition();
+        const glm::quat &rotation = m_pipeline.GetRotation();
 
-        pose.vecPosition[0] = joints[jHand].Position.X - joinPos.x;
-        pose.vecPosition[1] = joints[jHand].Position.Y - joinPos.y;
-        pose.vecPosition[2] = joints[jHand].Position.Z - joinPos.z;
+        pose.vecPosition[0] = position.x - joinPos.x;
+        pose.vecPosition[1] = position.y - joinPos.y;
+        pose.vecPosition[2] = position.z - joinPos.z;
 
         pose.qRotation.w = rotation.w;
         pose.qRotation.x = rotation.x;
@@ -580,6 +1025,15 @@ public:
     }
 
     void RunFrame() {
+        TRACE_SCOPE_ARG("RunFrame", m_pchTraceName);
+
+        // step filtering and prediction once per body frame, not once per RunFrame
+        if (m_lastBodyFrameIndex != bodyFrameIndex) {
+            TRACE_SCOPE_ARG("PosePipeline", m_pchTraceName);
+            m_pipeline.Update(bodyFrameTime, bodyJoints, jointRotations);
+            m_lastBodyFrameIndex = bodyFrameIndex;
+        }
+
         /*if(tracked && trackedFirstFrame){
             joinPos = glm::vec3(joints[jHand].Position.X, joints[jHand].Position.Y, joints[jHand].Position.Z);
             trackedFirstFrame = false;
@@ -594,9 +1048,70 @@ public:
             vr::VRDriverInput()->UpdateBooleanComponent(m_compTriggerClick, false, 0);
         }
 
+        UpdateSkeleton();
+
         VRServerDriverHost()->TrackedDevicePoseUpdated(m_unObjectId, GetPose(), sizeof(DriverPose_t));
     }
 
+    void UpdateSkeleton() {
+        if (m_compSkeleton == vr::k_ulInvalidInputComponentHandle)
+            return;
+
+        TRACE_SCOPE_ARG("UpdateSkeleton", m_pchTraceName);
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const float flDeltaSeconds = std::chrono::duration<float>(now - m_lastSkeletonUpdate).count();
+        m_lastSkeletonUpdate = now;
+
+        UpdateSkeletonTargetWeights();
+
+        const float flStep = m_flSkeletonBlendSeconds > 0.f ? flDeltaSeconds / m_flSkeletonBlendSeconds : 0.f;
+        if (!m_skeleton.Update(m_flSkeletonTargetWeights, flStep))
+            return;
+
+        // the hand isn't holding anything, so both motion ranges get the same pose
+        VRDriverInput()->UpdateSkeletonComponent(m_compSkeleton, VRSkeletalMotionRange_WithController, m_skeleton.GetBoneTransforms(), k_unHandSkeletonBoneCount);
+        VRDriverInput()->UpdateSkeletonComponent(m_compSkeleton, VRSkeletalMotionRange_WithoutController, m_skeleton.GetBoneTransforms(), k_unHandSkeletonBoneCount);
+    }
+
+    void UpdateSkeletonTargetWeights() {
+        EHandSkeletonPose eTarget;
+
+        switch (*m_pHandState) {
+            case HandState_Open:
+                eTarget = HandSkeletonPose_Open;
+                break;
+            case HandState_Closed:
+                eTarget = HandSkeletonPose_Closed;
+                break;
+            case HandState_Lasso:
+                eTarget = m_bLassoAsPoint ? HandSkeletonPose_Point : HandSkeletonPose_Lasso;
+                break;
+            default:
+            {
+                // No gesture from the sensor, estimate the finger curl from how far the hand tip
+                // sits from the hand center. Keep the previous target if neither joint is tracked.
+                if (joints[jTip].TrackingState != TrackingState_Tracked || joints[jHand].TrackingState != TrackingState_Tracked)
+                    return;
+
+                static const float k_flOpenTipDistance = 0.09f;
+                static const float k_flClosedTipDistance = 0.04f;
+
+                const glm::vec3 tip = glm::vec3(joints[jTip].Position.X, joints[jTip].Position.Y, joints[jTip].Position.Z);
+                const glm::vec3 hand = glm::vec3(joints[jHand].Position.X, joints[jHand].Position.Y, joints[jHand].Position.Z);
+                const float flCurl = glm::clamp((k_flOpenTipDistance - glm::length(tip - hand)) / (k_flOpenTipDistance - k_flClosedTipDistance), 0.f, 1.f);
+
+                memset(m_flSkeletonTargetWeights, 0, sizeof(m_flSkeletonTargetWeights));
+                m_flSkeletonTargetWeights[HandSkeletonPose_Open] = 1.f - flCurl;
+                m_flSkeletonTargetWeights[HandSkeletonPose_Closed] = flCurl;
+                return;
+            }
+        }
+
+        memset(m_flSkeletonTargetWeights, 0, sizeof(m_flSkeletonTargetWeights));
+        m_flSkeletonTargetWeights[eTarget] = 1.f;
+    }
+
     void ProcessEvent( const vr::VREvent_t & vrEvent )
     {
         switch ( vrEvent.eventType )
@@ -605,6 +1120,8 @@ public:
             {
                 if ( vrEvent.data.hapticVibration.componentHandle == m_compHaptic )
                 {
+                    TRACE_SCOPE_ARG( "HapticVibration", m_pchTraceName );
+
                     // This is where you would send a signal to your hardware to trigger actual haptic feedback
                     DriverLog( "BUZZ!\n" );
                 }
@@ -625,13 +1142,25 @@ private:
     vr::VRInputComponentHandle_t m_compTriggerValue;
     vr::VRInputComponentHandle_t m_compTriggerClick;
     vr::VRInputComponentHandle_t m_compHaptic;
+    vr::VRInputComponentHandle_t m_compSkeleton = vr::k_ulInvalidInputComponentHandle;
 
     std::string m_sSerialNumber;
     std::string m_sModelNumber;
 
     JointType jHand, jTip, jWrist, jElbow;
+    HandState *m_pHandState;
+    const char *m_pchTraceName = nullptr;   // string literal, trace events keep the pointer
+
+    CHandSkeleton m_skeleton;
+    float m_flSkeletonTargetWeights[HandSkeletonPose_Count] = {};
+    float m_flSkeletonBlendSeconds;
+    bool m_bLassoAsPoint;
+    std::chrono::steady_clock::time_point m_lastSkeletonUpdate;
 
     glm::vec3 joinPos{0,0,1.4};
+
+    CHandPosePipeline m_pipeline;
+    uint64_t m_lastBodyFrameIndex = 0;
 };
 
 //-----------------------------------------------------------------------------
@@ -644,11 +1173,24 @@ public:
     virtual void Cleanup() ;
     virtual const char * const *GetInterfaceVersions() { return vr::k_InterfaceVersions; }
     virtual void RunFrame() ;
-    virtual bool ShouldBlockStandbyMode()  { return true; }
-    virtual void EnterStandby()  {}
-    virtual void LeaveStandby()  {}
+    virtual bool ShouldBlockStandbyMode() ;
+    virtual void EnterStandby() ;
+    virtual void LeaveStandby() ;
 
 private:
+    bool RunPresenceCheck();
+
+    // Standby stops being blocked once nobody has been tracked for this long, <= 0 always blocks
+    float m_flStandbyTimeoutSeconds = 0.f;
+    // Pause between presence checks while in standby
+    float m_flPresenceCheckSeconds = 0.f;
+    // How long each presence check keeps body tracking running, the sensor needs a while to pick someone up
+    float m_flPresenceCheckWindowSeconds = 0.f;
+    bool m_bStandby = false;
+    bool m_bPresenceCheckRunning = false;   // body reader unpaused for a presence check
+    std::chrono::steady_clock::time_point m_standbyStartTime;
+    std::chrono::steady_clock::time_point m_lastPresenceCheck;     // start of the running check, or end of the last one
+
     CSampleDeviceDriver *m_pNullHmdLatest = nullptr;
     CSampleControllerDriver *m_pControllerRight = nullptr;
     CSampleControllerDriver *m_pControllerLeft = nullptr;
@@ -662,6 +1204,17 @@ EVRInitError CServerDriver_Sample::Init( vr::IVRDriverContext *pDriverContext )
     VR_INIT_SERVER_DRIVER_CONTEXT( pDriverContext );
     InitDriverLog( vr::VRDriverLog() );
 
+    m_flStandbyTimeoutSeconds = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_StandbyTimeoutSeconds_Float );
+    m_flPresenceCheckSeconds = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_PresenceCheckSeconds_Float );
+    m_flPresenceCheckWindowSeconds = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_PresenceCheckWindowSeconds_Float );
+    m_bStandby = false;
+
+    sensorLatencySeconds = vr::VRSettings()->GetFloat( k_pch_Sample_Section, k_pch_Sample_SensorLatencySeconds_Float );
+    loadJointOffsets( k_pch_Sample_Section );
+
+    // count the standby timeout from startup until someone is seen
+    lastBodyTrackedTime = std::chrono::steady_clock::now();
+
     m_pNullHmdLatest = new CSampleDeviceDriver();
     vr::VRServerDriverHost()->TrackedDeviceAdded( m_pNullHmdLatest->GetSerialNumber().c_str(), vr::TrackedDeviceClass_HMD, m_pNullHmdLatest );
 
@@ -676,6 +1229,10 @@ EVRInitError CServerDriver_Sample::Init( vr::IVRDriverContext *pDriverContext )
 
 void CServerDriver_Sample::Cleanup()
 {
+    // SteamVR may unload the provider without deactivating the HMD, the sensor thread
+    // must not outlive the DLL or log after the log is gone
+    stopKinectThread();
+
     CleanupDriverLog();
     delete m_pNullHmdLatest;
     m_pNullHmdLatest = NULL;
@@ -688,9 +1245,19 @@ void CServerDriver_Sample::Cleanup()
 
 void CServerDriver_Sample::RunFrame()
 {
-    if ( m_pNullHmdLatest ) m_pNullHmdLatest->RunFrame();
-    if ( m_pControllerRight ) m_pControllerRight->RunFrame();
-    if ( m_pControllerLeft ) m_pControllerLeft->RunFrame();
+    TRACE_THREAD_NAME( "RunFrame" );
+    TRACE_SCOPE( "CServerDriver_Sample::RunFrame" );
+
+    // In standby the body reader is paused, the devices keep their last state and only a low
+    // rate presence check runs
+    if ( !m_bStandby || RunPresenceCheck() )
+    {
+        if ( m_pNullHmdLatest ) m_pNullHmdLatest->RunFrame();
+        if ( m_pControllerRight ) m_pControllerRight->RunFrame();
+        if ( m_pControllerLeft ) m_pControllerLeft->RunFrame();
+    }
+
+    TRACE_SCOPE( "PollNextEvent" );
 
     vr::VREvent_t vrEvent;
     while ( vr::VRServerDriverHost()->PollNextEvent( &vrEvent, sizeof( vrEvent ) ) )
@@ -700,6 +1267,75 @@ void CServerDriver_Sample::RunFrame()
     }
 }
 
+bool CServerDriver_Sample::ShouldBlockStandbyMode()
+{
+    if ( m_flStandbyTimeoutSeconds <= 0.f )
+        return true;
+
+    const float flIdleSeconds = std::chrono::duration<float>( std::chrono::steady_clock::now() - lastBodyTrackedTime ).count();
+    return flIdleSeconds < m_flStandbyTimeoutSeconds;
+}
+
+void CServerDriver_Sample::EnterStandby()
+{
+    DriverLog( "Entering standby, body tracking paused\n" );
+    m_bStandby = true;
+    m_bPresenceCheckRunning = false;
+    m_standbyStartTime = std::chrono::steady_clock::now();
+    m_lastPresenceCheck = m_standbyStartTime;
+    setBodyReaderPaused( true );
+}
+
+void CServerDriver_Sample::LeaveStandby()
+{
+    if ( m_bStandby )
+        DriverLog( "Leaving standby\n" );
+    m_bStandby = false;
+    m_bPresenceCheckRunning = false;
+    setBodyReaderPaused( false );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: m_flPresenceCheckSeconds after the previous check ended, unpauses
+//          the body reader for m_flPresenceCheckWindowSeconds so the sensor
+//          gets the frames it needs to pick up a body, then pauses it again.
+//          Returns true once a body is tracked again, which ends standby so
+//          the devices resume from their previous state on this frame.
+//-----------------------------------------------------------------------------
+bool CServerDriver_Sample::RunPresenceCheck()
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if ( !m_bPresenceCheckRunning )
+    {
+        if ( std::chrono::duration<float>( now - m_lastPresenceCheck ).count() < m_flPresenceCheckSeconds )
+            return false;
+
+        m_lastPresenceCheck = now;
+        m_bPresenceCheckRunning = true;
+        setBodyReaderPaused( false );
+    }
+
+    TRACE_SCOPE( "PresenceCheck" );
+
+    getBodyData();
+    if ( lastBodyTrackedTime > m_standbyStartTime )
+    {
+        // the reader stays unpaused from here on
+        DriverLog( "Body tracked in standby, resuming\n" );
+        m_bStandby = false;
+        m_bPresenceCheckRunning = false;
+        return true;
+    }
+
+    if ( std::chrono::duration<float>( now - m_lastPresenceCheck ).count() > m_flPresenceCheckWindowSeconds )
+    {
+        m_lastPresenceCheck = now;
+        m_bPresenceCheckRunning = false;
+        setBodyReaderPaused( true );
+    }
+    return false;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -0,0 +1,168 @@
+#include "drivertrace.h"
+
+#if defined( KINECTVR_TRACE )
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#endif
+
+// Zones kept per thread. Older zones are overwritten once a thread wraps around.
+static const uint32_t k_unTraceEventsPerThread = 1 << 15;
+
+struct TraceEvent_t
+{
+    const char *pchName;
+    const char *pchArg;
+    uint64_t ulStartNs;
+    uint64_t ulDurationNs;
+};
+
+// Written only by its owning thread. The dump reads it concurrently and uses
+// unWriteCount to discard anything that may have been overwritten meanwhile.
+struct TraceThreadBuffer_t
+{
+    uint32_t unThreadId;
+    std::atomic<const char *> pchThreadName;
+    std::atomic<uint32_t> unWriteCount;
+    TraceThreadBuffer_t *pNext;
+    TraceEvent_t events[ k_unTraceEventsPerThread ];
+};
+
+// Buffers are pushed onto this list the first time a thread records a zone and never freed
+static std::atomic<TraceThreadBuffer_t *> s_pTraceBuffers{ nullptr };
+
+static const std::chrono::steady_clock::time_point s_traceEpoch = std::chrono::steady_clock::now();
+
+static uint64_t TraceNowNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - s_traceEpoch ).count();
+}
+
+static uint32_t TraceCurrentThreadId()
+{
+#if defined( _WIN32 )
+    return (uint32_t)GetCurrentThreadId();
+#else
+    return (uint32_t)std::hash<std::thread::id>()( std::this_thread::get_id() );
+#endif
+}
+
+static TraceThreadBuffer_t *GetThreadBuffer()
+{
+    static thread_local TraceThreadBuffer_t *s_pBuffer = nullptr;
+    if ( s_pBuffer )
+        return s_pBuffer;
+
+    TraceThreadBuffer_t *pBuffer = new TraceThreadBuffer_t;
+    pBuffer->unThreadId = TraceCurrentThreadId();
+    pBuffer->pchThreadName.store( nullptr );
+    pBuffer->unWriteCount.store( 0 );
+
+    pBuffer->pNext = s_pTraceBuffers.load( std::memory_order_relaxed );
+    while ( !s_pTraceBuffers.compare_exchange_weak( pBuffer->pNext, pBuffer, std::memory_order_release, std::memory_order_relaxed ) )
+    {
+    }
+
+    s_pBuffer = pBuffer;
+    return pBuffer;
+}
+
+CTraceScope::CTraceScope( const char *pchName, const char *pchArg )
+    : m_pchName( pchName ), m_pchArg( pchArg ), m_ulStartNs( TraceNowNs() )
+{
+}
+
+CTraceScope::~CTraceScope()
+{
+    const uint64_t ulEndNs = TraceNowNs();
+
+    TraceThreadBuffer_t *pBuffer = GetThreadBuffer();
+    const uint32_t unIndex = pBuffer->unWriteCount.load( std::memory_order_relaxed );
+
+    TraceEvent_t &event = pBuffer->events[ unIndex % k_unTraceEventsPerThread ];
+    event.pchName = m_pchName;
+    event.pchArg = m_pchArg;
+    event.ulStartNs = m_ulStartNs;
+    event.ulDurationNs = ulEndNs - m_ulStartNs;
+
+    pBuffer->unWriteCount.store( unIndex + 1, std::memory_order_release );
+}
+
+void TraceSetThreadName( const char *pchName )
+{
+    GetThreadBuffer()->pchThreadName.store( pchName, std::memory_order_release );
+}
+
+static FILE *OpenTraceFile( const char *pchPath )
+{
+#if defined( _WIN32 )
+    FILE *pFile = NULL;
+    if ( fopen_s( &pFile, pchPath, "w" ) != 0 )
+        return NULL;
+    return pFile;
+#else
+    return fopen( pchPath, "w" );
+#endif
+}
+
+bool TraceDump( const char *pchPath )
+{
+    FILE *pFile = OpenTraceFile( pchPath );
+    if ( !pFile )
+        return false;
+
+    fprintf( pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+    fprintf( pFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"driver_sample\"}}" );
+
+    std::vector<TraceEvent_t> events;
+    for ( TraceThreadBuffer_t *pBuffer = s_pTraceBuffers.load( std::memory_order_acquire ); pBuffer; pBuffer = pBuffer->pNext )
+    {
+        const char *pchThreadName = pBuffer->pchThreadName.load( std::memory_order_acquire );
+        if ( pchThreadName )
+        {
+            fprintf( pFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                pBuffer->unThreadId, pchThreadName );
+        }
+
+        // copy out the newest events, then drop any the owning thread lapped while we were copying
+        const uint32_t unEnd = pBuffer->unWriteCount.load( std::memory_order_acquire );
+        const uint32_t unBegin = unEnd > k_unTraceEventsPerThread ? unEnd - k_unTraceEventsPerThread : 0;
+
+        events.clear();
+        for ( uint32_t i = unBegin; i != unEnd; ++i )
+            events.push_back( pBuffer->events[ i % k_unTraceEventsPerThread ] );
+
+        // keeps the event reads above from moving past the count load below
+        std::atomic_thread_fence( std::memory_order_acquire );
+
+        // the writer may already be filling slot unEndAfterCopy, which holds event unEndAfterCopy - N
+        const uint32_t unEndAfterCopy = pBuffer->unWriteCount.load( std::memory_order_acquire );
+        const uint32_t unSafeBegin = unEndAfterCopy + 1 > k_unTraceEventsPerThread ? unEndAfterCopy + 1 - k_unTraceEventsPerThread : 0;
+
+        for ( uint32_t i = unBegin; i != unEnd; ++i )
+        {
+            if ( i < unSafeBegin )
+                continue;
+
+            const TraceEvent_t &event = events[ i - unBegin ];
+            fprintf( pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                event.pchName, pBuffer->unThreadId, event.ulStartNs / 1000.0, event.ulDurationNs / 1000.0 );
+            if ( event.pchArg )
+                fprintf( pFile, ",\"args\":{\"arg\":\"%s\"}", event.pchArg );
+            fprintf( pFile, "}" );
+        }
+    }
+
+    fprintf( pFile, "\n]}\n" );
+    fclose( pFile );
+    return true;
+}
+
+#endif // KINECTVR_TRACE
@@ -0,0 +1,54 @@
+#ifndef DRIVERTRACE_H
+#define DRIVERTRACE_H
+
+#pragma once
+
+#include <stdint.h>
+
+// --------------------------------------------------------------------------
+// Scoped timeline tracing. Build with KINECTVR_TRACE defined to record zones;
+// without it every TRACE_ macro compiles to nothing.
+//
+//   TRACE_SCOPE( "name" )              records the enclosing scope
+//   TRACE_SCOPE_ARG( "name", "arg" )   same, tagged with a second string
+//   TRACE_THREAD_NAME( "name" )        names the calling thread in the timeline
+//
+// Names and args must be string literals, they are stored by pointer.
+// TraceDump() writes everything recorded so far as Chrome trace JSON, which
+// chrome://tracing and ui.perfetto.dev both open.
+// --------------------------------------------------------------------------
+
+#if defined( KINECTVR_TRACE )
+
+class CTraceScope
+{
+public:
+    CTraceScope( const char *pchName, const char *pchArg = nullptr );
+    ~CTraceScope();
+
+private:
+    const char *m_pchName;
+    const char *m_pchArg;
+    uint64_t m_ulStartNs;
+};
+
+extern void TraceSetThreadName( const char *pchName );
+extern bool TraceDump( const char *pchPath );
+
+#define TRACE_CONCAT_INNER( a, b ) a##b
+#define TRACE_CONCAT( a, b ) TRACE_CONCAT_INNER( a, b )
+#define TRACE_SCOPE( name ) CTraceScope TRACE_CONCAT( _traceScope, __LINE__ )( name )
+#define TRACE_SCOPE_ARG( name, arg ) CTraceScope TRACE_CONCAT( _traceScope, __LINE__ )( name, arg )
+#define TRACE_THREAD_NAME( name ) TraceSetThreadName( name )
+
+#else
+
+inline bool TraceDump( const char * ) { return false; }
+
+#define TRACE_SCOPE( name )
+#define TRACE_SCOPE_ARG( name, arg )
+#define TRACE_THREAD_NAME( name )
+
+#endif
+
+#endif // DRIVERTRACE_H
@@ -0,0 +1,375 @@
+#include "handskeleton.h"
+
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+using namespace vr;
+
+// Bone indices of the OpenVR hand skeleton
+enum EHandSkeletonBone
+{
+    HandBone_Root = 0,
+    HandBone_Wrist,
+    HandBone_Thumb0,
+    HandBone_Thumb1,
+    HandBone_Thumb2,
+    HandBone_Thumb3,
+    HandBone_IndexFinger0,
+    HandBone_IndexFinger1,
+    HandBone_IndexFinger2,
+    HandBone_IndexFinger3,
+    HandBone_IndexFinger4,
+    HandBone_MiddleFinger0,
+    HandBone_MiddleFinger1,
+    HandBone_MiddleFinger2,
+    HandBone_MiddleFinger3,
+    HandBone_MiddleFinger4,
+    HandBone_RingFinger0,
+    HandBone_RingFinger1,
+    HandBone_RingFinger2,
+    HandBone_RingFinger3,
+    HandBone_RingFinger4,
+    HandBone_PinkyFinger0,
+    HandBone_PinkyFinger1,
+    HandBone_PinkyFinger2,
+    HandBone_PinkyFinger3,
+    HandBone_PinkyFinger4,
+    HandBone_Aux_Thumb,
+    HandBone_Aux_IndexFinger,
+    HandBone_Aux_MiddleFinger,
+    HandBone_Aux_RingFinger,
+    HandBone_Aux_PinkyFinger,
+};
+
+// Bones are processed four at a time, so the tables are padded to a multiple of four
+static const uint32_t k_unPaddedBoneCount = ( k_unHandSkeletonBoneCount + 3 ) & ~3u;
+
+// Left hand reference poses, in the parent space of each bone.
+// position { x, y, z, 1 }, orientation { w, x, y, z }
+static const VRBoneTransform_t s_leftOpenPose[ k_unHandSkeletonBoneCount ] =
+{
+    { {  0.000000f,  0.000000f,  0.000000f, 1.f }, {  1.000000f, -0.000000f, -0.000000f,  0.000000f } },
+    { { -0.034038f,  0.036503f,  0.164722f, 1.f }, { -0.055147f, -0.078608f, -0.920279f,  0.379296f } },
+    { { -0.012083f,  0.028070f,  0.025050f, 1.f }, {  0.464112f,  0.567418f,  0.272106f,  0.623374f } },
+    { {  0.040406f,  0.000000f, -0.000000f, 1.f }, {  0.994838f,  0.082939f,  0.019454f,  0.055130f } },
+    { {  0.032517f,  0.000000f,  0.000000f, 1.f }, {  0.974793f, -0.003213f,  0.021867f, -0.222015f } },
+    { {  0.030464f, -0.000000f, -0.000000f, 1.f }, {  1.000000f, -0.000000f, -0.000000f,  0.000000f } },
+    { {  0.000632f,  0.026866f,  0.015002f, 1.f }, {  0.644251f,  0.421979f, -0.478202f,  0.422133f } },
+    { {  0.074204f, -0.005002f,  0.000234f, 1.f }, {  0.995332f,  0.007007f, -0.039124f,  0.087949f } },
+    { {  0.043930f, -0.000000f, -0.000000f, 1.f }, {  0.997891f,  0.045808f,  0.002142f, -0.045943f } },
+    { {  0.028695f,  0.000000f,  0.000000f, 1.f }, {  0.999649f,  0.001850f, -0.022782f, -0.013409f } },
+    { {  0.022821f,  0.000000f, -0.000000f, 1.f }, {  1.000000f, -0.000000f,  0.000000f, -0.000000f } },
+    { {  0.002177f,  0.007120f,  0.016319f, 1.f }, {  0.546723f,  0.541276f, -0.442520f,  0.460749f } },
+    { {  0.070953f,  0.000779f,  0.000997f, 1.f }, {  0.980294f, -0.167261f, -0.078959f,  0.069368f } },
+    { {  0.043108f,  0.000000f,  0.000000f, 1.f }, {  0.997947f,  0.018493f,  0.013192f,  0.059886f } },
+    { {  0.033266f,  0.000000f,  0.000000f, 1.f }, {  0.997394f, -0.003328f, -0.028225f, -0.066315f } },
+    { {  0.025892f, -0.000000f,  0.000000f, 1.f }, {  0.999195f, -0.000000f,  0.000000f,  0.040126f } },
+    { {  0.000513f, -0.006545f,  0.016348f, 1.f }, {  0.516692f,  0.550143f, -0.495548f,  0.429888f } },
+    { {  0.065876f,  0.001786f,  0.000693f, 1.f }, {  0.990420f, -0.058696f, -0.101820f,  0.072495f } },
+    { {  0.040697f,  0.000000f,  0.000000f, 1.f }, {  0.999545f, -0.002240f,  0.000004f,  0.030081f } },
+    { {  0.028747f, -0.000000f, -0.000000f, 1.f }, {  0.999102f, -0.000721f, -0.012693f,  0.040420f } },
+    { {  0.022430f, -0.000000f,  0.000000f, 1.f }, {  1.000000f,  0.000000f,  0.000000f,  0.000000f } },
+    { { -0.002478f, -0.018981f,  0.015214f, 1.f }, {  0.526918f,  0.523940f, -0.584025f,  0.326740f } },
+    { {  0.062878f,  0.002844f,  0.000332f, 1.f }, {  0.986609f, -0.059615f, -0.135163f,  0.069132f } },
+    { {  0.030220f,  0.000000f,  0.000000f, 1.f }, {  0.994317f,  0.001896f, -0.000132f,  0.106446f } },
+    { {  0.018187f,  0.000000f,  0.000000f, 1.f }, {  0.995931f, -0.002010f, -0.052079f, -0.073526f } },
+    { {  0.018018f,  0.000000f, -0.000000f, 1.f }, {  1.000000f,  0.000000f,  0.000000f,  0.000000f } },
+    { { -0.006059f,  0.056285f,  0.060064f, 1.f }, {  0.737238f,  0.202745f,  0.594267f,  0.249441f } },
+    { { -0.040416f, -0.043018f,  0.019345f, 1.f }, { -0.290330f,  0.623527f, -0.663809f, -0.293734f } },
+    { { -0.039354f, -0.075674f,  0.047048f, 1.f }, { -0.187047f,  0.678062f, -0.659285f, -0.265683f } },
+    { { -0.038340f, -0.090987f,  0.082579f, 1.f }, { -0.183037f,  0.736793f, -0.634757f, -0.143936f } },
+    { { -0.031806f, -0.087214f,  0.121015f, 1.f }, { -0.003659f,  0.758407f, -0.639342f, -0.126678f } },
+};
+
+static const VRBoneTransform_t s_leftFistPose[ k_unHandSkeletonBoneCount ] =
+{
+    { {  0.000000f,  0.000000f,  0.000000f, 1.f }, {  1.000000f, -0.000000f, -0.000000f,  0.000000f } },
+    { { -0.034038f,  0.036503f,  0.164722f, 1.f }, { -0.055147f, -0.078608f, -0.920279f,  0.379296f } },
+    { { -0.016305f,  0.027529f,  0.017800f, 1.f }, {  0.225703f,  0.483332f,  0.126413f,  0.836342f } },
+    { {  0.040406f,  0.000000f, -0.000000f, 1.f }, {  0.894335f, -0.013302f, -0.082902f,  0.439448f } },
+    { {  0.032517f,  0.000000f,  0.000000f, 1.f }, {  0.842428f,  0.000655f,  0.001244f,  0.538807f } },
+    { {  0.030464f, -0.000000f, -0.000000f, 1.f }, {  1.000000f, -0.000000f, -0.000000f,  0.000000f } },
+    { {  0.003802f,  0.021514f,  0.012803f, 1.f }, {  0.617314f,  0.395175f, -0.510874f,  0.449185f } },
+    { {  0.074204f, -0.005002f,  0.000234f, 1.f }, {  0.737291f, -0.032006f, -0.115013f,  0.664944f } },
+    { {  0.043287f, -0.000000f, -0.000000f, 1.f }, {  0.611381f,  0.003287f,  0.003823f,  0.791321f } },
+    { {  0.028275f,  0.000000f,  0.000000f, 1.f }, {  0.745388f, -0.000684f, -0.000945f,  0.666629f } },
+    { {  0.022821f,  0.000000f, -0.000000f, 1.f }, {  1.000000f, -0.000000f,  0.000000f, -0.000000f } },
+    { {  0.005787f,  0.006806f,  0.016534f, 1.f }, {  0.514203f,  0.522315f, -0.478348f,  0.483700f } },
+    { {  0.070953f,  0.000779f,  0.000997f, 1.f }, {  0.723653f, -0.097901f,  0.048546f,  0.681458f } },
+    { {  0.043108f,  0.000000f,  0.000000f, 1.f }, {  0.637464f, -0.002366f, -0.002831f,  0.770472f } },
+    { {  0.033266f,  0.000000f,  0.000000f, 1.f }, {  0.658008f,  0.002610f,  0.003196f,  0.753000f } },
+    { {  0.025892f, -0.000000f,  0.000000f, 1.f }, {  0.999195f, -0.000000f,  0.000000f,  0.040126f } },
+    { {  0.004123f, -0.006858f,  0.016563f, 1.f }, {  0.489609f,  0.523374f, -0.520644f,  0.463997f } },
+    { {  0.065876f,  0.001786f,  0.000693f, 1.f }, {  0.759970f, -0.055609f,  0.011571f,  0.647471f } },
+    { {  0.040331f,  0.000000f,  0.000000f, 1.f }, {  0.664315f,  0.001595f,  0.001967f,  0.747449f } },
+    { {  0.028489f, -0.000000f, -0.000000f, 1.f }, {  0.626957f, -0.002784f, -0.003234f,  0.779042f } },
+    { {  0.022430f, -0.000000f,  0.000000f, 1.f }, {  1.000000f,  0.000000f,  0.000000f,  0.000000f } },
+    { {  0.001131f, -0.019295f,  0.015429f, 1.f }, {  0.479766f,  0.477833f, -0.630198f,  0.379934f } },
+    { {  0.062878f,  0.002844f,  0.000332f, 1.f }, {  0.827001f,  0.034282f,  0.003440f,  0.561144f } },
+    { {  0.029874f,  0.000000f,  0.000000f, 1.f }, {  0.702185f, -0.006716f, -0.009289f,  0.711903f } },
+    { {  0.017979f,  0.000000f,  0.000000f, 1.f }, {  0.676853f,  0.007956f,  0.009917f,  0.736009f } },
+    { {  0.018018f,  0.000000f, -0.000000f, 1.f }, {  1.000000f,  0.000000f,  0.000000f,  0.000000f } },
+    { {  0.019716f,  0.002802f,  0.093937f, 1.f }, {  0.377286f, -0.540831f,  0.150446f, -0.736562f } },
+    { {  0.000171f,  0.016473f,  0.096515f, 1.f }, { -0.006456f,  0.022747f, -0.932927f, -0.359287f } },
+    { {  0.000448f,  0.001536f,  0.116543f, 1.f }, { -0.039357f,  0.105143f, -0.928833f, -0.353079f } },
+    { {  0.003949f, -0.014869f,  0.130608f, 1.f }, { -0.055071f,  0.068695f, -0.944016f, -0.317933f } },
+    { {  0.003263f, -0.034685f,  0.139926f, 1.f }, {  0.019690f, -0.100741f, -0.957331f, -0.270149f } },
+};
+
+// Structure-of-arrays copy of one reference pose, laid out for the blend kernel
+struct alignas( 16 ) BonePoseTable_t
+{
+    float px[ k_unPaddedBoneCount ];
+    float py[ k_unPaddedBoneCount ];
+    float pz[ k_unPaddedBoneCount ];
+    float qw[ k_unPaddedBoneCount ];
+    float qx[ k_unPaddedBoneCount ];
+    float qy[ k_unPaddedBoneCount ];
+    float qz[ k_unPaddedBoneCount ];
+};
+
+struct HandPoseTables_t
+{
+    BonePoseTable_t poses[ 2 ][ HandSkeletonPose_Count ];  // [ left, right ][ pose ]
+};
+
+// True for the bones that stay extended in the given reference pose
+static bool IsBoneExtended( EHandSkeletonPose ePose, uint32_t unBone )
+{
+    const bool bIndex = ( unBone >= HandBone_IndexFinger0 && unBone <= HandBone_IndexFinger4 ) || unBone == HandBone_Aux_IndexFinger;
+    const bool bMiddle = ( unBone >= HandBone_MiddleFinger0 && unBone <= HandBone_MiddleFinger4 ) || unBone == HandBone_Aux_MiddleFinger;
+
+    switch ( ePose )
+    {
+    case HandSkeletonPose_Open:
+        return true;
+    case HandSkeletonPose_Lasso:
+        return bIndex || bMiddle;
+    case HandSkeletonPose_Point:
+        return bIndex;
+    default:
+        return false;
+    }
+}
+
+static bool IsMetacarpal( uint32_t unBone )
+{
+    return unBone == HandBone_Thumb0 || unBone == HandBone_IndexFinger0 || unBone == HandBone_MiddleFinger0
+        || unBone == HandBone_RingFinger0 || unBone == HandBone_PinkyFinger0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Turns a left hand bone transform into the matching right hand one.
+//
+// The right hand is the left one mirrored across the YZ plane, but SteamVR
+// keeps every bone frame right handed, so each frame is mirrored differently:
+// the root, wrist and aux frames are mirrored across YZ, the finger frames
+// are inverted through their origin. A bone's transform is therefore
+// conjugated by its parent's mirror on one side and its own on the other.
+//-----------------------------------------------------------------------------
+static void MirrorBoneToRightHand( uint32_t unBone, float *px, float *py, float *pz, float *qw, float *qx, float *qy, float *qz )
+{
+    if ( unBone == HandBone_Root )
+        return;
+
+    if ( IsMetacarpal( unBone ) )
+    {
+        // wrist parent, finger frame: a 180 degree turn about X in front of the left rotation
+        // e.g. thumb0 { 0.464112, 0.567418, 0.272106, 0.623374 } -> { 0.567418, -0.464112, 0.623374, -0.272106 }
+        const float w = *qw, x = *qx, y = *qy, z = *qz;
+        *px = -*px;
+        *qw = x;
+        *qx = -w;
+        *qy = z;
+        *qz = -y;
+    }
+    else if ( unBone < HandBone_Aux_Thumb && unBone != HandBone_Wrist )
+    {
+        // finger parent and finger frame: the inversion cancels out of the rotation
+        *px = -*px;
+        *py = -*py;
+        *pz = -*pz;
+    }
+    else
+    {
+        // wrist and aux bones, root parent and mirrored frame
+        *px = -*px;
+        *qy = -*qy;
+        *qz = -*qz;
+    }
+}
+
+static void BuildPoseTable( EHandSkeletonPose ePose, bool bRightHand, BonePoseTable_t *pTable )
+{
+    for ( uint32_t i = 0; i < k_unPaddedBoneCount; ++i )
+    {
+        if ( i >= k_unHandSkeletonBoneCount )
+        {
+            // padding lanes hold an identity transform so the normalize in the kernel stays finite
+            pTable->px[ i ] = pTable->py[ i ] = pTable->pz[ i ] = 0.f;
+            pTable->qw[ i ] = 1.f;
+            pTable->qx[ i ] = pTable->qy[ i ] = pTable->qz[ i ] = 0.f;
+            continue;
+        }
+
+        const VRBoneTransform_t &bone = IsBoneExtended( ePose, i ) ? s_leftOpenPose[ i ] : s_leftFistPose[ i ];
+        const VRBoneTransform_t &ref = s_leftOpenPose[ i ];
+        float px = bone.position.v[ 0 ], py = bone.position.v[ 1 ], pz = bone.position.v[ 2 ];
+        float qw = bone.orientation.w, qx = bone.orientation.x, qy = bone.orientation.y, qz = bone.orientation.z;
+
+        // Keep every pose in the same hemisphere as the open pose so a weighted sum of
+        // quaternions never cancels out
+        const float flDot = qw * ref.orientation.w + qx * ref.orientation.x + qy * ref.orientation.y + qz * ref.orientation.z;
+        if ( flDot < 0.f )
+        {
+            qw = -qw;
+            qx = -qx;
+            qy = -qy;
+            qz = -qz;
+        }
+
+        if ( bRightHand )
+            MirrorBoneToRightHand( i, &px, &py, &pz, &qw, &qx, &qy, &qz );
+
+        pTable->px[ i ] = px;
+        pTable->py[ i ] = py;
+        pTable->pz[ i ] = pz;
+        pTable->qw[ i ] = qw;
+        pTable->qx[ i ] = qx;
+        pTable->qy[ i ] = qy;
+        pTable->qz[ i ] = qz;
+    }
+}
+
+static const HandPoseTables_t &GetPoseTables()
+{
+    static const HandPoseTables_t *s_pTables = []()
+    {
+        HandPoseTables_t *pTables = new HandPoseTables_t;
+        for ( int nHand = 0; nHand < 2; ++nHand )
+        {
+            for ( int nPose = 0; nPose < HandSkeletonPose_Count; ++nPose )
+            {
+                BuildPoseTable( (EHandSkeletonPose)nPose, nHand == 1, &pTables->poses[ nHand ][ nPose ] );
+            }
+        }
+        return pTables;
+    }();
+    return *s_pTables;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Weighted blend of the reference poses, four bones per iteration.
+//          Positions are blended linearly, orientations with a normalized lerp.
+//-----------------------------------------------------------------------------
+static void BlendBonePoses( const BonePoseTable_t *pPoses, const float *pflWeights, BonePoseTable_t *pOut )
+{
+    const __m128 one = _mm_set1_ps( 1.f );
+
+    for ( uint32_t i = 0; i < k_unPaddedBoneCount; i += 4 )
+    {
+        __m128 px = _mm_setzero_ps(), py = _mm_setzero_ps(), pz = _mm_setzero_ps();
+        __m128 qw = _mm_setzero_ps(), qx = _mm_setzero_ps(), qy = _mm_setzero_ps(), qz = _mm_setzero_ps();
+
+        for ( int nPose = 0; nPose < HandSkeletonPose_Count; ++nPose )
+        {
+            if ( pflWeights[ nPose ] <= 0.f )
+                continue;
+
+            const BonePoseTable_t &pose = pPoses[ nPose ];
+            const __m128 w = _mm_set1_ps( pflWeights[ nPose ] );
+
+            px = _mm_add_ps( px, _mm_mul_ps( w, _mm_load_ps( &pose.px[ i ] ) ) );
+            py = _mm_add_ps( py, _mm_mul_ps( w, _mm_load_ps( &pose.py[ i ] ) ) );
+            pz = _mm_add_ps( pz, _mm_mul_ps( w, _mm_load_ps( &pose.pz[ i ] ) ) );
+            qw = _mm_add_ps( qw, _mm_mul_ps( w, _mm_load_ps( &pose.qw[ i ] ) ) );
+            qx = _mm_add_ps( qx, _mm_mul_ps( w, _mm_load_ps( &pose.qx[ i ] ) ) );
+            qy = _mm_add_ps( qy, _mm_mul_ps( w, _mm_load_ps( &pose.qy[ i ] ) ) );
+            qz = _mm_add_ps( qz, _mm_mul_ps( w, _mm_load_ps( &pose.qz[ i ] ) ) );
+        }
+
+        __m128 len2 = _mm_mul_ps( qw, qw );
+        len2 = _mm_add_ps( len2, _mm_mul_ps( qx, qx ) );
+        len2 = _mm_add_ps( len2, _mm_mul_ps( qy, qy ) );
+        len2 = _mm_add_ps( len2, _mm_mul_ps( qz, qz ) );
+        const __m128 invLen = _mm_div_ps( one, _mm_sqrt_ps( len2 ) );
+
+        _mm_store_ps( &pOut->px[ i ], px );
+        _mm_store_ps( &pOut->py[ i ], py );
+        _mm_store_ps( &pOut->pz[ i ], pz );
+        _mm_store_ps( &pOut->qw[ i ], _mm_mul_ps( qw, invLen ) );
+        _mm_store_ps( &pOut->qx[ i ], _mm_mul_ps( qx, invLen ) );
+        _mm_store_ps( &pOut->qy[ i ], _mm_mul_ps( qy, invLen ) );
+        _mm_store_ps( &pOut->qz[ i ], _mm_mul_ps( qz, invLen ) );
+    }
+}
+
+
+CHandSkeleton::CHandSkeleton()
+{
+    Init( false );
+}
+
+void CHandSkeleton::Init( bool bRightHand )
+{
+    m_bRightHand = bRightHand;
+    m_bDirty = true;
+
+    for ( int nPose = 0; nPose < HandSkeletonPose_Count; ++nPose )
+    {
+        m_flWeights[ nPose ] = nPose == HandSkeletonPose_Open ? 1.f : 0.f;
+        m_flEmittedWeights[ nPose ] = m_flWeights[ nPose ];
+    }
+
+    memset( m_boneTransforms, 0, sizeof( m_boneTransforms ) );
+}
+
+bool CHandSkeleton::Update( const float *pflTargetWeights, float flStep )
+{
+    // weights closer than this to the last emitted ones don't produce a visible change
+    static const float k_flWeightEpsilon = 1.0e-3f;
+
+    // Move the whole weight vector along a straight line to the target, so the weights keep
+    // summing to one mid blend and the blended bone positions don't stretch
+    float flMaxDelta = 0.f;
+    for ( int nPose = 0; nPose < HandSkeletonPose_Count; ++nPose )
+        flMaxDelta = fmaxf( flMaxDelta, fabsf( pflTargetWeights[ nPose ] - m_flWeights[ nPose ] ) );
+
+    const float flFraction = ( flStep <= 0.f || flMaxDelta <= flStep ) ? 1.f : flStep / flMaxDelta;
+
+    bool bChanged = m_bDirty;
+    for ( int nPose = 0; nPose < HandSkeletonPose_Count; ++nPose )
+    {
+        if ( flFraction >= 1.f )
+            m_flWeights[ nPose ] = pflTargetWeights[ nPose ];
+        else
+            m_flWeights[ nPose ] += ( pflTargetWeights[ nPose ] - m_flWeights[ nPose ] ) * flFraction;
+
+        if ( fabsf( m_flWeights[ nPose ] - m_flEmittedWeights[ nPose ] ) > k_flWeightEpsilon )
+            bChanged = true;
+    }
+
+    if ( !bChanged )
+        return false;
+
+    BonePoseTable_t blended;
+    BlendBonePoses( GetPoseTables().poses[ m_bRightHand ? 1 : 0 ], m_flWeights, &blended );
+
+    for ( uint32_t i = 0; i < k_unHandSkeletonBoneCount; ++i )
+    {
+        VRBoneTransform_t &bone = m_boneTransforms[ i ];
+        bone.position.v[ 0 ] = blended.px[ i ];
+        bone.position.v[ 1 ] = blended.py[ i ];
+        bone.position.v[ 2 ] = blended.pz[ i ];
+        bone.position.v[ 3 ] = 1.f;
+        bone.orientation.w = blended.qw[ i ];
+        bone.orientation.x = blended.qx[ i ];
+        bone.orientation.y = blended.qy[ i ];
+        bone.orientation.z = blended.qz[ i ];
+    }
+
+    memcpy( m_flEmittedWeights, m_flWeights, sizeof( m_flEmittedWeights ) );
+    m_bDirty = false;
+    return true;
+}
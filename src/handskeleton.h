@@ -0,0 +1,53 @@
+#ifndef HANDSKELETON_H
+#define HANDSKELETON_H
+
+#pragma once
+
+#include <openvr_driver.h>
+
+// Number of bones in the OpenVR hand skeleton (/skeleton/hand/left and /skeleton/hand/right)
+static const uint32_t k_unHandSkeletonBoneCount = 31;
+
+// Reference poses the skeleton is blended from
+enum EHandSkeletonPose
+{
+    HandSkeletonPose_Open = 0,
+    HandSkeletonPose_Closed,
+    HandSkeletonPose_Lasso,     // index and middle finger extended
+    HandSkeletonPose_Point,     // index finger extended
+
+    HandSkeletonPose_Count
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Blends precomputed reference hand poses into a set of bone
+//          transforms for IVRDriverInput::UpdateSkeletonComponent
+//-----------------------------------------------------------------------------
+class CHandSkeleton
+{
+public:
+    CHandSkeleton();
+
+    void Init( bool bRightHand );
+
+    // Moves the current blend weights towards pflTargetWeights (HandSkeletonPose_Count entries,
+    // summing to one), no single weight by more than flStep. Returns true when the weights moved far enough from the
+    // last emitted ones that the bone transforms were recomputed and should be sent to SteamVR.
+    bool Update( const float *pflTargetWeights, float flStep );
+
+    // Forces the next Update to recompute and report the bone transforms
+    void Invalidate() { m_bDirty = true; }
+
+    const vr::VRBoneTransform_t *GetBoneTransforms() const { return m_boneTransforms; }
+
+private:
+    bool m_bRightHand;
+    bool m_bDirty;
+
+    float m_flWeights[ HandSkeletonPose_Count ];
+    float m_flEmittedWeights[ HandSkeletonPose_Count ];
+
+    vr::VRBoneTransform_t m_boneTransforms[ k_unHandSkeletonBoneCount ];
+};
+
+#endif // HANDSKELETON_H
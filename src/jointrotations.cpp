@@ -0,0 +1,116 @@
+#include "jointrotations.h"
+
+#include <cmath>
+#include <xmmintrin.h>
+
+// Rotates the device -Z axis onto the joint +Y axis, 90 degrees about X
+static const float k_flAxisW = 0.70710678f;
+static const float k_flAxisX = 0.70710678f;
+
+// Sensor quaternions shorter than this (squared) carry no orientation, the leaf joints report zeros
+static const float k_flMinValidLengthSqr = 0.5f;
+
+CJointRotations::CJointRotations()
+{
+    for ( uint32_t i = 0; i < k_unMaxJoints; ++i )
+    {
+        SetOffset( i, 1.f, 0.f, 0.f, 0.f );
+
+        m_flSensorW[ i ] = 1.f;
+        m_flSensorX[ i ] = m_flSensorY[ i ] = m_flSensorZ[ i ] = 0.f;
+
+        m_flW[ i ] = 1.f;
+        m_flX[ i ] = m_flY[ i ] = m_flZ[ i ] = 0.f;
+        m_flValid[ i ] = 0.f;
+    }
+}
+
+void CJointRotations::SetOffset( uint32_t unJoint, float w, float x, float y, float z )
+{
+    if ( unJoint >= k_unMaxJoints )
+        return;
+
+    const float flLength = sqrtf( w * w + x * x + y * y + z * z );
+    if ( flLength <= 0.f )
+    {
+        w = 1.f;
+        x = y = z = 0.f;
+    }
+    else
+    {
+        w /= flLength;
+        x /= flLength;
+        y /= flLength;
+        z /= flLength;
+    }
+
+    // axis * offset, so the offset is applied in the device's own frame
+    m_flLocalW[ unJoint ] = k_flAxisW * w - k_flAxisX * x;
+    m_flLocalX[ unJoint ] = k_flAxisW * x + k_flAxisX * w;
+    m_flLocalY[ unJoint ] = k_flAxisW * y - k_flAxisX * z;
+    m_flLocalZ[ unJoint ] = k_flAxisW * z + k_flAxisX * y;
+}
+
+void CJointRotations::Convert( const float *pflOrientations, uint32_t unStride, uint32_t unCount )
+{
+    if ( unCount > k_unMaxJoints )
+        unCount = k_unMaxJoints;
+
+    for ( uint32_t i = 0; i < unCount; ++i )
+    {
+        const float *pflQuat = pflOrientations + i * unStride;
+        m_flSensorX[ i ] = pflQuat[ 0 ];
+        m_flSensorY[ i ] = pflQuat[ 1 ];
+        m_flSensorZ[ i ] = pflQuat[ 2 ];
+        m_flSensorW[ i ] = pflQuat[ 3 ];
+    }
+    for ( uint32_t i = unCount; i < k_unMaxJoints; ++i )
+    {
+        m_flSensorW[ i ] = m_flSensorX[ i ] = m_flSensorY[ i ] = m_flSensorZ[ i ] = 0.f;
+    }
+
+    const __m128 minLengthSqr = _mm_set1_ps( k_flMinValidLengthSqr );
+    const __m128 one = _mm_set1_ps( 1.f );
+
+    for ( uint32_t i = 0; i < k_unMaxJoints; i += 4 )
+    {
+        const __m128 aw = _mm_load_ps( &m_flSensorW[ i ] );
+        const __m128 ax = _mm_load_ps( &m_flSensorX[ i ] );
+        const __m128 ay = _mm_load_ps( &m_flSensorY[ i ] );
+        const __m128 az = _mm_load_ps( &m_flSensorZ[ i ] );
+
+        const __m128 bw = _mm_load_ps( &m_flLocalW[ i ] );
+        const __m128 bx = _mm_load_ps( &m_flLocalX[ i ] );
+        const __m128 by = _mm_load_ps( &m_flLocalY[ i ] );
+        const __m128 bz = _mm_load_ps( &m_flLocalZ[ i ] );
+
+        __m128 lengthSqr = _mm_mul_ps( aw, aw );
+        lengthSqr = _mm_add_ps( lengthSqr, _mm_mul_ps( ax, ax ) );
+        lengthSqr = _mm_add_ps( lengthSqr, _mm_mul_ps( ay, ay ) );
+        lengthSqr = _mm_add_ps( lengthSqr, _mm_mul_ps( az, az ) );
+        const __m128 valid = _mm_cmpgt_ps( lengthSqr, minLengthSqr );
+
+        // invalid lanes divide by one instead of zero, their result is never used
+        const __m128 invLength = _mm_div_ps( one, _mm_sqrt_ps( _mm_or_ps( _mm_and_ps( valid, lengthSqr ), _mm_andnot_ps( valid, one ) ) ) );
+
+        // sensor * local
+        __m128 w = _mm_sub_ps( _mm_sub_ps( _mm_mul_ps( aw, bw ), _mm_mul_ps( ax, bx ) ), _mm_add_ps( _mm_mul_ps( ay, by ), _mm_mul_ps( az, bz ) ) );
+        __m128 x = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( aw, bx ), _mm_mul_ps( ax, bw ) ), _mm_mul_ps( ay, bz ) ), _mm_mul_ps( az, by ) );
+        __m128 y = _mm_add_ps( _mm_add_ps( _mm_sub_ps( _mm_mul_ps( aw, by ), _mm_mul_ps( ax, bz ) ), _mm_mul_ps( ay, bw ) ), _mm_mul_ps( az, bx ) );
+        __m128 z = _mm_add_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( aw, bz ), _mm_mul_ps( ax, by ) ), _mm_mul_ps( ay, bx ) ), _mm_mul_ps( az, bw ) );
+
+        _mm_store_ps( &m_flW[ i ], _mm_mul_ps( w, invLength ) );
+        _mm_store_ps( &m_flX[ i ], _mm_mul_ps( x, invLength ) );
+        _mm_store_ps( &m_flY[ i ], _mm_mul_ps( y, invLength ) );
+        _mm_store_ps( &m_flZ[ i ], _mm_mul_ps( z, invLength ) );
+        _mm_store_ps( &m_flValid[ i ], _mm_and_ps( valid, one ) );
+    }
+}
+
+void CJointRotations::GetRotation( uint32_t unJoint, float *pflW, float *pflX, float *pflY, float *pflZ ) const
+{
+    *pflW = m_flW[ unJoint ];
+    *pflX = m_flX[ unJoint ];
+    *pflY = m_flY[ unJoint ];
+    *pflZ = m_flZ[ unJoint ];
+}
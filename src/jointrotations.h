@@ -0,0 +1,56 @@
+#ifndef JOINTROTATIONS_H
+#define JOINTROTATIONS_H
+
+#pragma once
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Purpose: Converts the per-joint orientations reported by the sensor into
+//          driver space device rotations.
+//
+// The sensor orients each joint with its +Y axis along the bone, while a
+// tracked device points down its -Z axis. Every joint is rotated into that
+// convention and then by a per-joint offset. All joints are converted in one
+// pass, four at a time. Quaternions are { w, x, y, z } unless noted.
+//-----------------------------------------------------------------------------
+class CJointRotations
+{
+public:
+    // Enough for the 25 joints of a Kinect body, padded to a multiple of four
+    static const uint32_t k_unMaxJoints = 28;
+
+    CJointRotations();
+
+    // Extra rotation applied in the joint's local space after the axis conversion
+    void SetOffset( uint32_t unJoint, float w, float x, float y, float z );
+
+    // pflOrientations holds unCount sensor quaternions as { x, y, z, w }, unStride floats apart
+    void Convert( const float *pflOrientations, uint32_t unStride, uint32_t unCount );
+
+    // False for joints the sensor gave no usable orientation for, e.g. the leaf joints
+    bool IsValid( uint32_t unJoint ) const { return m_flValid[ unJoint ] != 0.f; }
+
+    void GetRotation( uint32_t unJoint, float *pflW, float *pflX, float *pflY, float *pflZ ) const;
+
+private:
+    // axis conversion followed by the offset, per joint
+    alignas( 16 ) float m_flLocalW[ k_unMaxJoints ];
+    alignas( 16 ) float m_flLocalX[ k_unMaxJoints ];
+    alignas( 16 ) float m_flLocalY[ k_unMaxJoints ];
+    alignas( 16 ) float m_flLocalZ[ k_unMaxJoints ];
+
+    // sensor orientations gathered into structure-of-arrays form
+    alignas( 16 ) float m_flSensorW[ k_unMaxJoints ];
+    alignas( 16 ) float m_flSensorX[ k_unMaxJoints ];
+    alignas( 16 ) float m_flSensorY[ k_unMaxJoints ];
+    alignas( 16 ) float m_flSensorZ[ k_unMaxJoints ];
+
+    alignas( 16 ) float m_flW[ k_unMaxJoints ];
+    alignas( 16 ) float m_flX[ k_unMaxJoints ];
+    alignas( 16 ) float m_flY[ k_unMaxJoints ];
+    alignas( 16 ) float m_flZ[ k_unMaxJoints ];
+    alignas( 16 ) float m_flValid[ k_unMaxJoints ];
+};
+
+#endif // JOINTROTATIONS_H
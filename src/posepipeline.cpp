@@ -0,0 +1,126 @@
+#include "posepipeline.h"
+
+#include <cmath>
+
+// A gap this long between body frames restarts the filter instead of smoothing across it
+static const double k_flMaxFrameGapSeconds = 0.5;
+
+static const float k_flPi = 3.14159265f;
+
+int SelectTrackedBody( const bool *pbTracked, uint32_t unCount )
+{
+    for ( uint32_t i = 0; i < unCount; ++i )
+    {
+        if ( pbTracked[ i ] )
+            return (int)i;
+    }
+    return -1;
+}
+
+PosePipelineConfig_t DefaultPosePipelineConfig()
+{
+    PosePipelineConfig_t config;
+    config.flMinCutoff = 0.f;
+    config.flBeta = 0.f;
+    config.flDerivativeCutoff = 1.f;
+    config.flPredictionSeconds = 0.f;
+    return config;
+}
+
+// Smoothing factor of a first order low pass at flCutoff Hz for a step of flDeltaTime seconds
+static float LowPassAlpha( float flCutoff, float flDeltaTime )
+{
+    const float flTau = 1.f / ( 2.f * k_flPi * flCutoff );
+    return 1.f / ( 1.f + flTau / flDeltaTime );
+}
+
+
+CHandPosePipeline::CHandPosePipeline()
+{
+    Init( DefaultPosePipelineConfig(), 0, 0, 0 );
+}
+
+void CHandPosePipeline::Init( const PosePipelineConfig_t &config, uint32_t unHandJoint, uint32_t unTipJoint, uint32_t unWristJoint )
+{
+    m_config = config;
+    m_unHandJoint = unHandJoint;
+    m_unTipJoint = unTipJoint;
+    m_unWristJoint = unWristJoint;
+
+    m_position = glm::vec3( 0.f );
+    m_rotation = glm::quat( 1.f, 0.f, 0.f, 0.f );
+    Reset();
+}
+
+void CHandPosePipeline::Reset()
+{
+    m_bHasState = false;
+    m_flLastTime = 0.0;
+    m_filteredPosition = glm::vec3( 0.f );
+    m_filteredVelocity = glm::vec3( 0.f );
+    m_predictionVelocity = glm::vec3( 0.f );
+}
+
+void CHandPosePipeline::Update( double flTime, const BodyJoint_t *pJoints, const CJointRotations &rotations )
+{
+    const glm::vec3 &raw = pJoints[ m_unHandJoint ].position;
+    const float flDeltaTime = (float)( flTime - m_flLastTime );
+
+    if ( !m_bHasState || flDeltaTime <= 0.f || flDeltaTime > k_flMaxFrameGapSeconds )
+    {
+        m_filteredPosition = raw;
+        m_filteredVelocity = glm::vec3( 0.f );
+        m_predictionVelocity = glm::vec3( 0.f );
+        m_bHasState = true;
+    }
+    else
+    {
+        const float flDerivativeAlpha = LowPassAlpha( m_config.flDerivativeCutoff, flDeltaTime );
+
+        // One Euro filter: smooth the speed estimate, then open the position cutoff as the hand moves faster.
+        // This speed is measured against the filter's own lagging output, so it only drives the cutoff.
+        const glm::vec3 velocity = ( raw - m_filteredPosition ) / flDeltaTime;
+        m_filteredVelocity = glm::mix( m_filteredVelocity, velocity, flDerivativeAlpha );
+
+        const glm::vec3 previousPosition = m_filteredPosition;
+        if ( m_config.flMinCutoff > 0.f )
+        {
+            const float flCutoff = m_config.flMinCutoff + m_config.flBeta * glm::length( m_filteredVelocity );
+            m_filteredPosition = glm::mix( m_filteredPosition, raw, LowPassAlpha( flCutoff, flDeltaTime ) );
+        }
+        else
+        {
+            m_filteredPosition = raw;
+        }
+
+        // Prediction extrapolates along the velocity of consecutive outputs
+        const glm::vec3 outputVelocity = ( m_filteredPosition - previousPosition ) / flDeltaTime;
+        m_predictionVelocity = glm::mix( m_predictionVelocity, outputVelocity, flDerivativeAlpha );
+    }
+    m_flLastTime = flTime;
+
+    m_position = m_filteredPosition + m_predictionVelocity * m_config.flPredictionSeconds;
+    m_rotation = ComputeRotation( pJoints, rotations );
+}
+
+glm::quat CHandPosePipeline::ComputeRotation( const BodyJoint_t *pJoints, const CJointRotations &rotations )
+{
+    // The sensor derives the hand orientation from the hand tip, so only trust it while both are tracked
+    if ( rotations.IsValid( m_unHandJoint )
+        && pJoints[ m_unHandJoint ].nTrackingState == BodyJointTracking_Tracked
+        && pJoints[ m_unTipJoint ].nTrackingState == BodyJointTracking_Tracked )
+    {
+        glm::quat rotation;
+        rotations.GetRotation( m_unHandJoint, &rotation.w, &rotation.x, &rotation.y, &rotation.z );
+        return rotation;
+    }
+
+    const glm::vec3 delta = pJoints[ m_unTipJoint ].position - pJoints[ m_unWristJoint ].position;
+    if ( glm::length( delta ) < 1.0e-4f )
+        return m_rotation;
+
+    // quatLookAt degenerates when the hand points straight up or down, use the sensor axis as up then
+    const glm::vec3 direction = glm::normalize( delta );
+    const glm::vec3 up = fabsf( direction.y ) > 0.99f ? glm::vec3( 0, 0, 1 ) : glm::vec3( 0, 1, 0 );
+    return glm::quatLookAt( direction, up );
+}
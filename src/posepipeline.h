@@ -0,0 +1,97 @@
+#ifndef POSEPIPELINE_H
+#define POSEPIPELINE_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "jointrotations.h"
+
+// Sensor independent copies of the Kinect body limits, so the pipeline also builds without the SDK
+static const uint32_t k_unBodyJointCount = 25;     // JointType_Count
+static const uint32_t k_unMaxBodies = 6;           // BODY_COUNT
+
+// Kinect JointType indices of the joints the hand pipelines read
+static const uint32_t k_unBodyJointWristLeft = 6;       // JointType_WristLeft
+static const uint32_t k_unBodyJointHandLeft = 7;        // JointType_HandLeft
+static const uint32_t k_unBodyJointWristRight = 10;     // JointType_WristRight
+static const uint32_t k_unBodyJointHandRight = 11;      // JointType_HandRight
+static const uint32_t k_unBodyJointHandTipLeft = 21;    // JointType_HandTipLeft
+static const uint32_t k_unBodyJointHandTipRight = 23;   // JointType_HandTipRight
+
+// Same values as the Kinect TrackingState enum
+enum EBodyJointTracking
+{
+    BodyJointTracking_NotTracked = 0,
+    BodyJointTracking_Inferred = 1,
+    BodyJointTracking_Tracked = 2,
+};
+
+struct BodyJoint_t
+{
+    glm::vec3 position;
+    int32_t nTrackingState;     // EBodyJointTracking
+};
+
+// Returns the index of the body the driver follows, the first tracked one, or -1
+extern int SelectTrackedBody( const bool *pbTracked, uint32_t unCount );
+
+struct PosePipelineConfig_t
+{
+    // One Euro filter on the hand position. flMinCutoff <= 0 disables the filter.
+    float flMinCutoff;          // Hz, cutoff while the hand is still
+    float flBeta;               // cutoff increase per m/s of hand speed
+    float flDerivativeCutoff;   // Hz, smoothing of the speed estimate
+
+    // Extrapolates the filtered position along its own velocity, smoothed at flDerivativeCutoff
+    float flPredictionSeconds;
+};
+
+extern PosePipelineConfig_t DefaultPosePipelineConfig();
+
+//-----------------------------------------------------------------------------
+// Purpose: Turns the joints of one hand into a device position and rotation.
+//          Stepped once per body frame, shared by the driver and the offline
+//          evaluation tool so both run exactly the same processing.
+//-----------------------------------------------------------------------------
+class CHandPosePipeline
+{
+public:
+    CHandPosePipeline();
+
+    void Init( const PosePipelineConfig_t &config, uint32_t unHandJoint, uint32_t unTipJoint, uint32_t unWristJoint );
+
+    // Drops the filter state, the next Update starts from the raw joints
+    void Reset();
+
+    // flTime is the body frame time in seconds, pJoints holds k_unBodyJointCount joints
+    void Update( double flTime, const BodyJoint_t *pJoints, const CJointRotations &rotations );
+
+    const glm::vec3 &GetPosition() const { return m_position; }
+
+    // Body frame time the position is for, the last Update's flTime plus the prediction
+    double GetPoseTime() const { return m_flLastTime + m_config.flPredictionSeconds; }
+    const glm::quat &GetRotation() const { return m_rotation; }
+
+private:
+    glm::quat ComputeRotation( const BodyJoint_t *pJoints, const CJointRotations &rotations );
+
+    PosePipelineConfig_t m_config;
+    uint32_t m_unHandJoint;
+    uint32_t m_unTipJoint;
+    uint32_t m_unWristJoint;
+
+    bool m_bHasState;
+    double m_flLastTime;
+    glm::vec3 m_filteredPosition;
+    glm::vec3 m_filteredVelocity;      // One Euro speed signal, only drives the cutoff
+    glm::vec3 m_predictionVelocity;    // smoothed velocity of the filtered output
+
+    glm::vec3 m_position;
+    glm::quat m_rotation;
+};
+
+#endif // POSEPIPELINE_H
@@ -0,0 +1,100 @@
+#include "skeletonrecording.h"
+
+#include <string.h>
+
+#if !defined( _WIN32 )
+#define fscanf_s fscanf
+#endif
+
+static const char k_pchRecordingHeader[] = "kinectvr-skeleton 1";
+
+bool WriteRecordingHeader( FILE *pFile )
+{
+    return fprintf( pFile, "%s\n", k_pchRecordingHeader ) > 0;
+}
+
+bool WriteRecordedFrame( FILE *pFile, const RecordedBodyFrame_t &frame )
+{
+    uint32_t unTracked = 0;
+    for ( uint32_t i = 0; i < k_unMaxBodies; ++i )
+    {
+        if ( frame.bodies[ i ].bTracked )
+            ++unTracked;
+    }
+
+    if ( fprintf( pFile, "frame %.7f %.7f %u\n", frame.flSensorTime, frame.flHostTime, unTracked ) < 0 )
+        return false;
+
+    for ( uint32_t i = 0; i < k_unMaxBodies; ++i )
+    {
+        const RecordedBody_t &body = frame.bodies[ i ];
+        if ( !body.bTracked )
+            continue;
+
+        fprintf( pFile, "body %u %d %d", i, body.nHandLeftState, body.nHandRightState );
+        for ( uint32_t j = 0; j < k_unBodyJointCount; ++j )
+        {
+            const BodyJoint_t &joint = body.joints[ j ];
+            fprintf( pFile, " %.5f %.5f %.5f %d", joint.position.x, joint.position.y, joint.position.z, joint.nTrackingState );
+        }
+        for ( uint32_t j = 0; j < k_unBodyJointCount; ++j )
+        {
+            const float *pflQuat = body.flOrientations[ j ];
+            fprintf( pFile, " %.5f %.5f %.5f %.5f", pflQuat[ 0 ], pflQuat[ 1 ], pflQuat[ 2 ], pflQuat[ 3 ] );
+        }
+        if ( fprintf( pFile, "\n" ) < 0 )
+            return false;
+    }
+
+    return true;
+}
+
+bool ReadRecordingHeader( FILE *pFile )
+{
+    char buf[ 64 ];
+    if ( !fgets( buf, sizeof( buf ), pFile ) )
+        return false;
+
+    buf[ strcspn( buf, "\r\n" ) ] = 0;
+    return !strcmp( buf, k_pchRecordingHeader );
+}
+
+bool ReadRecordedFrame( FILE *pFile, RecordedBodyFrame_t *pFrame )
+{
+    unsigned int unTracked = 0;
+    if ( fscanf_s( pFile, " frame %lf %lf %u", &pFrame->flSensorTime, &pFrame->flHostTime, &unTracked ) != 3 )
+        return false;
+
+    for ( uint32_t i = 0; i < k_unMaxBodies; ++i )
+        pFrame->bodies[ i ].bTracked = false;
+
+    for ( uint32_t n = 0; n < unTracked; ++n )
+    {
+        unsigned int unIndex = 0;
+        int nHandLeftState = 0, nHandRightState = 0;
+        if ( fscanf_s( pFile, " body %u %d %d", &unIndex, &nHandLeftState, &nHandRightState ) != 3 || unIndex >= k_unMaxBodies )
+            return false;
+
+        RecordedBody_t &body = pFrame->bodies[ unIndex ];
+        body.bTracked = true;
+        body.nHandLeftState = nHandLeftState;
+        body.nHandRightState = nHandRightState;
+
+        for ( uint32_t j = 0; j < k_unBodyJointCount; ++j )
+        {
+            BodyJoint_t &joint = body.joints[ j ];
+            int nTrackingState = 0;
+            if ( fscanf_s( pFile, "%f %f %f %d", &joint.position.x, &joint.position.y, &joint.position.z, &nTrackingState ) != 4 )
+                return false;
+            joint.nTrackingState = nTrackingState;
+        }
+        for ( uint32_t j = 0; j < k_unBodyJointCount; ++j )
+        {
+            float *pflQuat = body.flOrientations[ j ];
+            if ( fscanf_s( pFile, "%f %f %f %f", &pflQuat[ 0 ], &pflQuat[ 1 ], &pflQuat[ 2 ], &pflQuat[ 3 ] ) != 4 )
+                return false;
+        }
+    }
+
+    return true;
+}
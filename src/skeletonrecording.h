@@ -0,0 +1,43 @@
+#ifndef SKELETONRECORDING_H
+#define SKELETONRECORDING_H
+
+#pragma once
+
+#include <stdio.h>
+
+#include "posepipeline.h"
+
+// --------------------------------------------------------------------------
+// Text recording of raw body frames, written by the driver on request and
+// replayed by tools/trackeval. One header line, then per frame:
+//
+//   frame <sensor time> <host time> <body count>
+//   body <index> <left hand state> <right hand state> { x y z tracking } x25 { qx qy qz qw } x25
+//
+// with one body line for every tracked body. Times are in seconds.
+// --------------------------------------------------------------------------
+
+struct RecordedBody_t
+{
+    bool bTracked;
+    int32_t nHandLeftState;
+    int32_t nHandRightState;
+    BodyJoint_t joints[ k_unBodyJointCount ];
+    float flOrientations[ k_unBodyJointCount ][ 4 ];    // x y z w, as the sensor reports them
+};
+
+struct RecordedBodyFrame_t
+{
+    double flSensorTime;
+    double flHostTime;
+    RecordedBody_t bodies[ k_unMaxBodies ];
+};
+
+extern bool WriteRecordingHeader( FILE *pFile );
+extern bool WriteRecordedFrame( FILE *pFile, const RecordedBodyFrame_t &frame );
+
+extern bool ReadRecordingHeader( FILE *pFile );
+// Returns false at the end of the file or on malformed input
+extern bool ReadRecordedFrame( FILE *pFile, RecordedBodyFrame_t *pFrame );
+
+#endif // SKELETONRECORDING_H
@@ -0,0 +1,547 @@
+//-----------------------------------------------------------------------------
+// trackeval: replays skeleton recordings through the driver's pose pipeline
+// with different filter and prediction settings and scores each setting.
+//
+// Recordings come from the driver's "record_start <path>" / "record_stop"
+// debug requests. Build it next to the driver sources, for example
+//
+//   cl /O2 /EHsc /I<glm> tools\trackeval\trackeval.cpp src\posepipeline.cpp src\jointrotations.cpp src\skeletonrecording.cpp
+//   g++ -O2 -std=c++14 -pthread -I<glm> tools/trackeval/trackeval.cpp src/posepipeline.cpp src/jointrotations.cpp src/skeletonrecording.cpp
+//
+// Every configuration is reported with
+//   jitter     RMS of the output's energy above the reference cutoff, in mm
+//   lag        delay of the output against a zero-phase low passed copy of
+//              the raw joints, in ms. Negative means the output leads.
+//   overshoot  99th percentile of how far the output runs ahead of the
+//              reference along the recent direction of travel, in mm
+//
+// Lag and overshoot compare each output with the reference at the time the
+// driver reports it for, its body frame time plus the prediction, so they
+// measure how far the pose is off from its own timestamp.
+//   cpu        pipeline time per body frame, in microseconds
+//-----------------------------------------------------------------------------
+
+#include "../../src/posepipeline.h"
+#include "../../src/jointrotations.h"
+#include "../../src/skeletonrecording.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined( _WIN32 )
+#define sscanf_s sscanf
+#endif
+
+// Same gap the pipeline resets its filter on, metrics are not computed across it either
+static const double k_flMaxFrameGapSeconds = 0.5;
+
+// Shortest run of consecutive frames worth scoring
+static const size_t k_unMinSegmentFrames = 16;
+
+// Lag is searched within +- this many frames
+static const int k_nMaxLagFrames = 15;
+
+// Overshoot is measured along the reference's travel over this many frames, once it moved at least k_flMinTravel meters
+static const size_t k_unTravelFrames = 5;
+static const float k_flMinTravel = 0.02f;
+
+struct Recording_t
+{
+    std::string sPath;
+    std::vector<RecordedBodyFrame_t> frames;
+};
+
+struct Config_t
+{
+    std::string sName;
+    PosePipelineConfig_t pipeline;
+};
+
+// Per job sums, merged per configuration once all jobs finished
+struct Score_t
+{
+    double flJitterSumSqr = 0.0;
+    uint64_t ulJitterSamples = 0;
+
+    double flLagCorrelation[ 2 * k_nMaxLagFrames + 1 ] = {};
+    double flFrameSeconds = 0.0;
+    uint64_t ulFrameSecondsSamples = 0;
+
+    std::vector<float> overshoots;
+
+    double flCpuSeconds = 0.0;
+    uint64_t ulFrames = 0;
+
+    void Merge( const Score_t &other )
+    {
+        flJitterSumSqr += other.flJitterSumSqr;
+        ulJitterSamples += other.ulJitterSamples;
+        for ( int i = 0; i < 2 * k_nMaxLagFrames + 1; ++i )
+            flLagCorrelation[ i ] += other.flLagCorrelation[ i ];
+        flFrameSeconds += other.flFrameSeconds;
+        ulFrameSecondsSamples += other.ulFrameSecondsSamples;
+        overshoots.insert( overshoots.end(), other.overshoots.begin(), other.overshoots.end() );
+        flCpuSeconds += other.flCpuSeconds;
+        ulFrames += other.ulFrames;
+    }
+};
+
+struct Job_t
+{
+    const Config_t *pConfig;
+    const Recording_t *pRecording;
+    Score_t score;
+};
+
+// One hand's samples between two gaps
+struct Segment_t
+{
+    std::vector<double> times;
+    std::vector<glm::vec3> raw;
+    std::vector<glm::vec3> output;
+    std::vector<double> outputTimes;    // time each output is reported for
+};
+
+
+static FILE *OpenRecording( const char *pchPath )
+{
+#if defined( _WIN32 )
+    FILE *pFile = NULL;
+    if ( fopen_s( &pFile, pchPath, "r" ) != 0 )
+        return NULL;
+    return pFile;
+#else
+    return fopen( pchPath, "r" );
+#endif
+}
+
+static bool LoadRecording( const char *pchPath, Recording_t *pRecording )
+{
+    FILE *pFile = OpenRecording( pchPath );
+    if ( !pFile )
+    {
+        fprintf( stderr, "trackeval: can't open %s\n", pchPath );
+        return false;
+    }
+
+    if ( !ReadRecordingHeader( pFile ) )
+    {
+        fprintf( stderr, "trackeval: %s is not a skeleton recording\n", pchPath );
+        fclose( pFile );
+        return false;
+    }
+
+    pRecording->sPath = pchPath;
+    RecordedBodyFrame_t frame;
+    while ( ReadRecordedFrame( pFile, &frame ) )
+        pRecording->frames.push_back( frame );
+
+    fclose( pFile );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Zero-phase second order Butterworth low pass, run forwards then
+//          backwards so the result has no delay against its input
+//-----------------------------------------------------------------------------
+static void FilterForward( std::vector<glm::vec3> &samples, float flCutoff, float flSampleRate )
+{
+    const float flW0 = 2.f * 3.14159265f * std::min( flCutoff, 0.45f * flSampleRate ) / flSampleRate;
+    const float flAlpha = sinf( flW0 ) / ( 2.f * 0.70710678f );
+    const float flCos = cosf( flW0 );
+    const float a0 = 1.f + flAlpha;
+    const float b0 = ( 1.f - flCos ) / 2.f / a0;
+    const float b1 = ( 1.f - flCos ) / a0;
+    const float b2 = b0;
+    const float a1 = -2.f * flCos / a0;
+    const float a2 = ( 1.f - flAlpha ) / a0;
+
+    // start settled on the first sample so the edges don't ring
+    glm::vec3 x1 = samples[ 0 ], x2 = samples[ 0 ], y1 = samples[ 0 ], y2 = samples[ 0 ];
+    for ( glm::vec3 &sample : samples )
+    {
+        const glm::vec3 x0 = sample;
+        const glm::vec3 y0 = b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+        sample = y0;
+    }
+}
+
+static std::vector<glm::vec3> ZeroPhaseLowPass( const std::vector<glm::vec3> &samples, float flCutoff, float flSampleRate )
+{
+    // odd reflection at both ends keeps the start and end slopes
+    const size_t unPad = std::min<size_t>( samples.size() - 1, 12 );
+    std::vector<glm::vec3> padded;
+    padded.reserve( samples.size() + 2 * unPad );
+    for ( size_t i = unPad; i > 0; --i )
+        padded.push_back( 2.f * samples.front() - samples[ i ] );
+    padded.insert( padded.end(), samples.begin(), samples.end() );
+    for ( size_t i = 1; i <= unPad; ++i )
+        padded.push_back( 2.f * samples.back() - samples[ samples.size() - 1 - i ] );
+
+    FilterForward( padded, flCutoff, flSampleRate );
+    std::reverse( padded.begin(), padded.end() );
+    FilterForward( padded, flCutoff, flSampleRate );
+    std::reverse( padded.begin(), padded.end() );
+
+    return std::vector<glm::vec3>( padded.begin() + unPad, padded.begin() + unPad + samples.size() );
+}
+
+// Linear interpolation of samples taken at times, false past either end
+static bool SampleAt( const std::vector<double> &times, const std::vector<glm::vec3> &samples, double flTime, glm::vec3 *pSample )
+{
+    if ( flTime < times.front() || flTime > times.back() )
+        return false;
+
+    const size_t unNext = std::upper_bound( times.begin(), times.end(), flTime ) - times.begin();
+    if ( unNext >= times.size() )
+    {
+        *pSample = samples.back();
+        return true;
+    }
+
+    const double flSpan = times[ unNext ] - times[ unNext - 1 ];
+    const float flFraction = flSpan > 0.0 ? (float)( ( flTime - times[ unNext - 1 ] ) / flSpan ) : 0.f;
+    *pSample = glm::mix( samples[ unNext - 1 ], samples[ unNext ], flFraction );
+    return true;
+}
+
+static void ScoreSegment( const Segment_t &segment, float flReferenceCutoff, Score_t *pScore )
+{
+    const size_t unCount = segment.times.size();
+    if ( unCount < k_unMinSegmentFrames )
+        return;
+
+    std::vector<double> deltas;
+    for ( size_t i = 1; i < unCount; ++i )
+        deltas.push_back( segment.times[ i ] - segment.times[ i - 1 ] );
+    std::nth_element( deltas.begin(), deltas.begin() + deltas.size() / 2, deltas.end() );
+    const double flFrameSeconds = deltas[ deltas.size() / 2 ];
+    if ( flFrameSeconds <= 0.0 )
+        return;
+
+    const float flSampleRate = (float)( 1.0 / flFrameSeconds );
+    pScore->flFrameSeconds += flFrameSeconds;
+    ++pScore->ulFrameSecondsSamples;
+
+    const std::vector<glm::vec3> reference = ZeroPhaseLowPass( segment.raw, flReferenceCutoff, flSampleRate );
+    const std::vector<glm::vec3> smoothOutput = ZeroPhaseLowPass( segment.output, flReferenceCutoff, flSampleRate );
+
+    // jitter, whatever the output carries above the reference band
+    for ( size_t i = 0; i < unCount; ++i )
+    {
+        const glm::vec3 highPass = segment.output[ i ] - smoothOutput[ i ];
+        pScore->flJitterSumSqr += glm::dot( highPass, highPass );
+    }
+    pScore->ulJitterSamples += unCount;
+
+    // the reference at the times the outputs are reported for, outputs reported past the end aren't scored
+    std::vector<glm::vec3> target;
+    for ( size_t i = 0; i < unCount; ++i )
+    {
+        glm::vec3 sample;
+        if ( !SampleAt( segment.times, reference, segment.outputTimes[ i ], &sample ) )
+            break;
+        target.push_back( sample );
+    }
+    const size_t unScored = target.size();
+
+    // lag, by cross correlating frame to frame motion of the output and the reference
+    for ( int nShift = -k_nMaxLagFrames; nShift <= k_nMaxLagFrames; ++nShift )
+    {
+        double flSum = 0.0;
+        for ( size_t i = 1; i < unScored; ++i )
+        {
+            const long nRef = (long)i - nShift;
+            if ( nRef < 1 || nRef >= (long)unScored )
+                continue;
+            const glm::vec3 outputVelocity = segment.output[ i ] - segment.output[ i - 1 ];
+            const glm::vec3 targetVelocity = target[ nRef ] - target[ nRef - 1 ];
+            flSum += glm::dot( outputVelocity, targetVelocity );
+        }
+        pScore->flLagCorrelation[ nShift + k_nMaxLagFrames ] += flSum;
+    }
+
+    // overshoot, how far the output is ahead of the reference along its recent travel
+    for ( size_t i = k_unTravelFrames; i < unScored; ++i )
+    {
+        const glm::vec3 travel = target[ i ] - target[ i - k_unTravelFrames ];
+        const float flTravel = glm::length( travel );
+        if ( flTravel < k_flMinTravel )
+            continue;
+
+        const float flLead = glm::dot( segment.output[ i ] - target[ i ], travel / flTravel );
+        pScore->overshoots.push_back( std::max( flLead, 0.f ) );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs one recording through both hands' pipelines the way the
+//          driver does, one Update per body frame with a tracked body
+//-----------------------------------------------------------------------------
+static void RunJob( Job_t *pJob, float flReferenceCutoff )
+{
+    CHandPosePipeline pipelines[ 2 ];
+    pipelines[ 0 ].Init( pJob->pConfig->pipeline, k_unBodyJointHandLeft, k_unBodyJointHandTipLeft, k_unBodyJointWristLeft );
+    pipelines[ 1 ].Init( pJob->pConfig->pipeline, k_unBodyJointHandRight, k_unBodyJointHandTipRight, k_unBodyJointWristRight );
+    const uint32_t unHandJoints[ 2 ] = { k_unBodyJointHandLeft, k_unBodyJointHandRight };
+
+    CJointRotations rotations;
+    Segment_t segments[ 2 ];
+    double flLastTime = 0.0;
+    bool bHasLastTime = false;
+
+    for ( const RecordedBodyFrame_t &frame : pJob->pRecording->frames )
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        bool bTracked[ k_unMaxBodies ];
+        for ( uint32_t i = 0; i < k_unMaxBodies; ++i )
+            bTracked[ i ] = frame.bodies[ i ].bTracked;
+
+        const int nBody = SelectTrackedBody( bTracked, k_unMaxBodies );
+        if ( nBody >= 0 )
+        {
+            const RecordedBody_t &body = frame.bodies[ nBody ];
+            rotations.Convert( &body.flOrientations[ 0 ][ 0 ], 4, k_unBodyJointCount );
+            pipelines[ 0 ].Update( frame.flSensorTime, body.joints, rotations );
+            pipelines[ 1 ].Update( frame.flSensorTime, body.joints, rotations );
+        }
+
+        pJob->score.flCpuSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        ++pJob->score.ulFrames;
+
+        const bool bGap = nBody < 0 || ( bHasLastTime && frame.flSensorTime - flLastTime > k_flMaxFrameGapSeconds );
+        if ( bGap )
+        {
+            for ( int nHand = 0; nHand < 2; ++nHand )
+            {
+                ScoreSegment( segments[ nHand ], flReferenceCutoff, &pJob->score );
+                segments[ nHand ] = Segment_t();
+            }
+        }
+
+        if ( nBody < 0 )
+            continue;
+
+        for ( int nHand = 0; nHand < 2; ++nHand )
+        {
+            segments[ nHand ].times.push_back( frame.flSensorTime );
+            segments[ nHand ].raw.push_back( frame.bodies[ nBody ].joints[ unHandJoints[ nHand ] ].position );
+            segments[ nHand ].output.push_back( pipelines[ nHand ].GetPosition() );
+            segments[ nHand ].outputTimes.push_back( pipelines[ nHand ].GetPoseTime() );
+        }
+        flLastTime = frame.flSensorTime;
+        bHasLastTime = true;
+    }
+
+    for ( int nHand = 0; nHand < 2; ++nHand )
+        ScoreSegment( segments[ nHand ], flReferenceCutoff, &pJob->score );
+}
+
+static bool ParseConfig( const char *pchArg, Config_t *pConfig )
+{
+    std::string sArg = pchArg;
+    const size_t unEquals = sArg.find( '=' );
+    std::string sValues = unEquals == std::string::npos ? sArg : sArg.substr( unEquals + 1 );
+
+    PosePipelineConfig_t &config = pConfig->pipeline;
+    config = DefaultPosePipelineConfig();
+    if ( sscanf_s( sValues.c_str(), "%f,%f,%f,%f", &config.flMinCutoff, &config.flBeta, &config.flDerivativeCutoff, &config.flPredictionSeconds ) != 4
+        || config.flDerivativeCutoff <= 0.f )
+    {
+        return false;
+    }
+
+    pConfig->sName = unEquals == std::string::npos ? sArg : sArg.substr( 0, unEquals );
+    return true;
+}
+
+static void AddSweepConfigs( std::vector<Config_t> *pConfigs )
+{
+    static const float k_flMinCutoffs[] = { 0.f, 0.5f, 1.f, 2.f, 4.f };
+    static const float k_flBetas[] = { 0.f, 0.5f, 2.f };
+    static const float k_flPredictions[] = { 0.f, 0.033f, 0.066f };
+
+    for ( float flMinCutoff : k_flMinCutoffs )
+    {
+        for ( float flBeta : k_flBetas )
+        {
+            // beta only matters with the filter on
+            if ( flMinCutoff <= 0.f && flBeta != k_flBetas[ 0 ] )
+                continue;
+
+            for ( float flPrediction : k_flPredictions )
+            {
+                Config_t config;
+                config.pipeline = DefaultPosePipelineConfig();
+                config.pipeline.flMinCutoff = flMinCutoff;
+                config.pipeline.flBeta = flBeta;
+                config.pipeline.flPredictionSeconds = flPrediction;
+
+                char buf[ 64 ];
+                snprintf( buf, sizeof( buf ), "%g,%g,%g,%g", flMinCutoff, flBeta, config.pipeline.flDerivativeCutoff, flPrediction );
+                config.sName = buf;
+                pConfigs->push_back( config );
+            }
+        }
+    }
+}
+
+static void PrintUsage()
+{
+    fprintf( stderr,
+        "usage: trackeval [options] <recording>...\n"
+        "  --config [name=]minCutoff,beta,derivativeCutoff,predictionSeconds\n"
+        "                        evaluate this configuration, may be repeated\n"
+        "  --sweep               evaluate a built-in grid (default without --config)\n"
+        "  --reference-cutoff <hz>\n"
+        "                        cutoff of the zero-phase reference, default 5\n"
+        "  --threads <n>         worker threads, default one per core\n" );
+}
+
+int main( int argc, char **argv )
+{
+    std::vector<Config_t> configs;
+    std::vector<Recording_t> recordings;
+    bool bSweep = false;
+    float flReferenceCutoff = 5.f;
+    unsigned int unThreads = std::thread::hardware_concurrency();
+
+    std::vector<const char *> paths;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( !strcmp( argv[ i ], "--config" ) && i + 1 < argc )
+        {
+            Config_t config;
+            if ( !ParseConfig( argv[ ++i ], &config ) )
+            {
+                fprintf( stderr, "trackeval: bad configuration \"%s\"\n", argv[ i ] );
+                return 1;
+            }
+            configs.push_back( config );
+        }
+        else if ( !strcmp( argv[ i ], "--sweep" ) )
+        {
+            bSweep = true;
+        }
+        else if ( !strcmp( argv[ i ], "--reference-cutoff" ) && i + 1 < argc )
+        {
+            flReferenceCutoff = (float)atof( argv[ ++i ] );
+        }
+        else if ( !strcmp( argv[ i ], "--threads" ) && i + 1 < argc )
+        {
+            unThreads = (unsigned int)atoi( argv[ ++i ] );
+        }
+        else if ( argv[ i ][ 0 ] == '-' )
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+        {
+            paths.push_back( argv[ i ] );
+        }
+    }
+
+    if ( paths.empty() || flReferenceCutoff <= 0.f )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if ( bSweep || configs.empty() )
+        AddSweepConfigs( &configs );
+
+    recordings.resize( paths.size() );
+    for ( size_t i = 0; i < paths.size(); ++i )
+    {
+        if ( !LoadRecording( paths[ i ], &recordings[ i ] ) )
+            return 1;
+    }
+
+    std::vector<Job_t> jobs;
+    for ( const Config_t &config : configs )
+    {
+        for ( const Recording_t &recording : recordings )
+        {
+            Job_t job;
+            job.pConfig = &config;
+            job.pRecording = &recording;
+            jobs.push_back( job );
+        }
+    }
+
+    // every job is independent, workers just pull the next one
+    std::atomic<size_t> nextJob{ 0 };
+    auto worker = [ & ]()
+    {
+        for ( size_t i = nextJob++; i < jobs.size(); i = nextJob++ )
+            RunJob( &jobs[ i ], flReferenceCutoff );
+    };
+
+    unThreads = std::max( 1u, std::min<unsigned int>( unThreads, (unsigned int)jobs.size() ) );
+    std::vector<std::thread> threads;
+    for ( unsigned int i = 0; i < unThreads; ++i )
+        threads.emplace_back( worker );
+    for ( std::thread &thread : threads )
+        thread.join();
+
+    printf( "%-28s %10s %10s %10s %13s %10s\n", "config", "frames", "jitter_mm", "lag_ms", "overshoot_mm", "cpu_us" );
+    for ( size_t nConfig = 0; nConfig < configs.size(); ++nConfig )
+    {
+        Score_t score;
+        for ( const Job_t &job : jobs )
+        {
+            if ( job.pConfig == &configs[ nConfig ] )
+                score.Merge( job.score );
+        }
+
+        const double flJitter = score.ulJitterSamples ? sqrt( score.flJitterSumSqr / score.ulJitterSamples ) * 1000.0 : 0.0;
+
+        // peak of the correlation, refined with a parabola through its neighbours
+        int nPeak = 0;
+        for ( int i = 1; i < 2 * k_nMaxLagFrames + 1; ++i )
+        {
+            if ( score.flLagCorrelation[ i ] > score.flLagCorrelation[ nPeak ] )
+                nPeak = i;
+        }
+        double flPeak = nPeak;
+        if ( nPeak > 0 && nPeak < 2 * k_nMaxLagFrames )
+        {
+            const double l = score.flLagCorrelation[ nPeak - 1 ], c = score.flLagCorrelation[ nPeak ], r = score.flLagCorrelation[ nPeak + 1 ];
+            const double flDenominator = l - 2.0 * c + r;
+            if ( flDenominator < 0.0 )
+                flPeak += 0.5 * ( l - r ) / flDenominator;
+        }
+        const double flFrameSeconds = score.ulFrameSecondsSamples ? score.flFrameSeconds / score.ulFrameSecondsSamples : 0.0;
+        const double flLag = ( flPeak - k_nMaxLagFrames ) * flFrameSeconds * 1000.0;
+
+        double flOvershoot = 0.0;
+        if ( !score.overshoots.empty() )
+        {
+            const size_t unIndex = (size_t)( 0.99 * ( score.overshoots.size() - 1 ) );
+            std::nth_element( score.overshoots.begin(), score.overshoots.begin() + unIndex, score.overshoots.end() );
+            flOvershoot = score.overshoots[ unIndex ] * 1000.0;
+        }
+
+        const double flCpu = score.ulFrames ? score.flCpuSeconds / score.ulFrames * 1.0e6 : 0.0;
+
+        printf( "%-28s %10llu %10.3f %10.1f %13.2f %10.3f\n", configs[ nConfig ].sName.c_str(),
+            (unsigned long long)score.ulFrames, flJitter, flLag, flOvershoot, flCpu );
+    }
+
+    return 0;
+}